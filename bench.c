@@ -0,0 +1,580 @@
+#define _POSIX_C_SOURCE 200809L // для clock_gettime, fdopen и fileno при -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "graph.h"
+#include "loader.h"
+#include "mmfile.h"
+#include "utf8.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#define NULL_DEVICE "NUL"
+#else
+#include <time.h>
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+// Бенчмарк: генерирует синтетическое родословное дерево в формате load_from_file
+// и замеряет основные операции графа. Результаты — CSV в stdout, по строке на операцию:
+//   operation,samples,items,total_sec,items_per_sec,p50_us,p99_us,max_us
+// Вывод самих операций (списки потомков, наследство) уходит в NULL_DEVICE.
+//
+// Сборка: gcc -O2 bench.c graph.c loader.c mmfile.c threadpool.c utf8.c -lm -lpthread -o bench
+
+#define BENCH_MAX_NAME 96
+
+// Параметры генератора и замеров
+typedef struct {
+    long n;              // Количество людей
+    double fanout;       // Среднее число детей у пары
+    int generations;     // Число поколений
+    double collapse;     // Доля браков между родственниками (схлопывание родословной)
+    double dead;         // Доля умерших
+    uint64_t seed;       // Зерно генератора
+    long samples;        // Замеров для лёгких операций (поиск, добавление, удаление)
+    long heavy_samples;  // Замеров для обходов (потомки, путь, наследство)
+    int runs;            // Повторов загрузки и экспорта
+    int threads;         // Потоков разбора, обхода по уровням и пакетов запросов (0 — автоматически)
+    const char* path;    // Файл для сгенерированных данных
+    int generate_only;   // Только сгенерировать файл, без замеров
+    int keep;            // Не удалять сгенерированный файл
+} BenchOptions;
+
+// Человек сгенерированного дерева
+typedef struct {
+    int gender;     // 0 — мужчина, 1 — женщина
+    int surname;    // Индекс фамилии (наследуется от отца)
+    int first;      // Индекс имени
+    int birth;      // Год рождения
+    int death;      // Год смерти или -1
+} GenPerson;
+
+static const char* MALE_NAMES[] = {
+    "Александр", "Андрей", "Борис", "Василий", "Владимир", "Григорий", "Дмитрий",
+    "Евгений", "Иван", "Кирилл", "Михаил", "Николай", "Павел", "Пётр", "Сергей", "Фёдор"
+};
+static const char* FEMALE_NAMES[] = {
+    "Анастасия", "Анна", "Валентина", "Дарья", "Екатерина", "Елена", "Мария", "Наталья",
+    "Ольга", "Светлана", "Софья", "Татьяна", "Ульяна", "Юлия", "Алла", "Вера"
+};
+static const char* SURNAMES[] = {
+    "Иванов", "Петров", "Смирнов", "Кузнецов", "Попов", "Соколов", "Лебедев", "Козлов",
+    "Новиков", "Морозов", "Волков", "Соловьёв", "Васильев", "Зайцев", "Павлов", "Семёнов",
+    "Голубев", "Виноградов", "Богданов", "Воробьёв", "Фёдоров", "Михайлов", "Беляев",
+    "Тарасов", "Белов", "Комаров", "Орлов", "Киселёв", "Макаров", "Андреев", "Никитин",
+    "Егоров", "Ильин", "Гусев", "Титов", "Кузьмин"
+};
+#define COUNT_OF(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// --- Генератор псевдослучайных чисел (xorshift64*) --- //
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static long rng_below(long n) {
+    return n > 0 ? (long)(rng_next() % (uint64_t)n) : 0;
+}
+
+static double rng_unit(void) {
+    return (double)(rng_next() >> 11) / 9007199254740992.0;
+}
+
+// --- Таймер --- //
+static double now_sec(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Имя человека: "Имя Фамилия номер"; номер делает имена уникальными
+static void format_name(const GenPerson* p, long id, char* out, size_t size) {
+    const char* first = p->gender ? FEMALE_NAMES[p->first] : MALE_NAMES[p->first];
+    snprintf(out, size, "%s %s%s %ld", first, SURNAMES[p->surname], p->gender ? "а" : "", id);
+}
+
+// --- Генерация дерева --- //
+// Поколение 0 — основатели; каждое следующее поколение рождается у пар предыдущего.
+// Размер основателей подобран так, чтобы за generations поколений набралось n человек
+// при росте fanout / 2 за поколение; последнее поколение обрезается до n.
+// С вероятностью collapse партнёр выбирается среди ближайших соседей по поколению
+// (обычно двоюродные братья и сёстры), иначе — случайно по всему поколению.
+// Если поколения вымерли раньше, людей будет меньше n: *people_out — сколько записано.
+static int generate_tree(const BenchOptions* o, long* people_out, long* relations_out) {
+    FILE* f = fopen(o->path, "w");
+    if (!f) {
+        perror(o->path);
+        return -1;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+    GenPerson* people = malloc(sizeof(GenPerson) * o->n);
+    long* parents = malloc(sizeof(long) * 2 * o->n);
+    if (!people || !parents) {
+        free(people);
+        free(parents);
+        fclose(f);
+        return -1;
+    }
+
+    double growth = o->fanout / 2.0, total = 0.0, scale = 1.0;
+    for (int i = 0; i < o->generations; i++) {
+        total += scale;
+        scale *= growth;
+    }
+    long founders = (long)(o->n / total);
+    if (founders < 2) founders = 2;
+    if (founders > o->n) founders = o->n;
+
+    long size = 0;
+    for (; size < founders; size++) {
+        GenPerson* p = &people[size];
+        p->gender = (int)(size & 1);
+        p->surname = (int)rng_below(COUNT_OF(SURNAMES));
+        p->first = (int)rng_below(COUNT_OF(MALE_NAMES));
+        p->birth = 1500 + (int)rng_below(30);
+        parents[2 * size] = parents[2 * size + 1] = -1;
+    }
+
+    long gen_start = 0, gen_end = size;
+    while (size < o->n) {
+        long gen_size = gen_end - gen_start;
+        long couples = gen_size / 2;
+        if (couples == 0) break;
+        for (long c = 0; c < couples && size < o->n; c++) {
+            long a = gen_start + 2 * c;
+            long b;
+            if (rng_unit() < o->collapse) {
+                long window = gen_size < 16 ? gen_size : 16;
+                b = gen_start + (2 * c + 1 + rng_below(window - 1)) % gen_size;
+            } else {
+                b = gen_start + rng_below(gen_size);
+            }
+            if (b == a) b = a + 1;
+            long father = people[a].gender == 0 ? a : b;
+            int kids = (int)o->fanout + (rng_unit() < o->fanout - (int)o->fanout);
+            int oldest = people[a].birth > people[b].birth ? people[a].birth : people[b].birth;
+            for (int k = 0; k < kids && size < o->n; k++, size++) {
+                GenPerson* p = &people[size];
+                p->gender = (int)(rng_next() & 1);
+                p->surname = people[father].surname;
+                p->first = (int)rng_below(COUNT_OF(MALE_NAMES));
+                p->birth = oldest + 18 + (int)rng_below(25);
+                parents[2 * size] = a;
+                parents[2 * size + 1] = b;
+            }
+        }
+        if (size == gen_end) break; // поколение вымерло
+        gen_start = gen_end;
+        gen_end = size;
+    }
+    if (size < o->n)
+        fprintf(stderr, "Поколения вымерли: сгенерировано %ld из %ld человек\n", size, o->n);
+
+    char name[BENCH_MAX_NAME], other[BENCH_MAX_NAME];
+    for (long i = 0; i < size; i++) {
+        GenPerson* p = &people[i];
+        p->death = rng_unit() < o->dead ? p->birth + 1 + (int)rng_below(90) : -1;
+        format_name(p, i, name, sizeof(name));
+        fprintf(f, "%s;%c;%d;%d\n", name, p->gender ? 'F' : 'M', p->birth, p->death);
+    }
+    fputc('\n', f);
+    long relations = 0;
+    for (long i = 0; i < size; i++) {
+        format_name(&people[i], i, name, sizeof(name));
+        for (int k = 0; k < 2; k++) {
+            long parent = parents[2 * i + k];
+            if (parent < 0) continue;
+            format_name(&people[parent], parent, other, sizeof(other));
+            fprintf(f, "%s;%s\n", other, name);
+            relations++;
+        }
+    }
+
+    free(people);
+    free(parents);
+    if (fclose(f) != 0) return -1;
+    if (people_out) *people_out = size;
+    if (relations_out) *relations_out = relations;
+    return 0;
+}
+
+// --- Замеры --- //
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Печатает строку CSV по замерам lat (в секундах); items — объём работы за все замеры
+static void report(FILE* out, const char* op, double* lat, long samples, double items) {
+    if (samples <= 0) return;
+    double total = 0.0;
+    for (long i = 0; i < samples; i++) total += lat[i];
+    qsort(lat, samples, sizeof(double), compare_doubles);
+    double p50 = lat[(long)((samples - 1) * 0.50)];
+    double p99 = lat[(long)((samples - 1) * 0.99)];
+    fprintf(out, "%s,%ld,%.0f,%.6f,%.1f,%.3f,%.3f,%.3f\n", op, samples, items, total,
+            total > 0 ? items / total : 0.0, p50 * 1e6, p99 * 1e6, lat[samples - 1] * 1e6);
+    fflush(out);
+}
+
+// Случайный живой человек графа
+static const char* random_name(const Graph* g) {
+    for (;;) {
+        long i = rng_below(g->size);
+        if (!g->vertices[i].removed) return g->vertices[i].name;
+    }
+}
+
+// Случайный живой человек из первых слотов: основатели и ранние поколения,
+// у которых потомков больше всего
+static const char* random_early_name(const Graph* g) {
+    for (;;) {
+        long i = rng_below(g->size / 100 + 1);
+        if (!g->vertices[i].removed) return g->vertices[i].name;
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Использование: %s [параметры]\n"
+            "  -n N     количество людей (по умолчанию 100000)\n"
+            "  -f F     среднее число детей у пары (2.5)\n"
+            "  -g G     число поколений (12)\n"
+            "  -c P     доля браков между родственниками, 0..1 (0.1)\n"
+            "  -d P     доля умерших, 0..1 (0.7)\n"
+            "  -s SEED  зерно генератора (1)\n"
+            "  -q N     замеров лёгких операций (10000)\n"
+            "  -Q N     замеров обходов (100)\n"
+            "  -r N     повторов загрузки и экспорта (3)\n"
+            "  -t N     потоков разбора, обхода по уровням и пакетов запросов (0 — автоматически)\n"
+            "  -o FILE  файл для данных (bench_tree.txt)\n"
+            "  -G       только сгенерировать файл\n"
+            "  -k       не удалять сгенерированный файл\n",
+            prog);
+}
+
+static int parse_options(int argc, char** argv, BenchOptions* o) {
+    o->n = 100000;
+    o->fanout = 2.5;
+    o->generations = 12;
+    o->collapse = 0.1;
+    o->dead = 0.7;
+    o->seed = 1;
+    o->samples = 10000;
+    o->heavy_samples = 100;
+    o->runs = 3;
+    o->threads = 0;
+    o->path = "bench_tree.txt";
+    o->generate_only = 0;
+    o->keep = 0;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (a[0] != '-' || !a[1] || a[2]) return -1;
+        if (a[1] == 'G') { o->generate_only = 1; o->keep = 1; continue; }
+        if (a[1] == 'k') { o->keep = 1; continue; }
+        if (i + 1 >= argc) return -1;
+        const char* v = argv[++i];
+        switch (a[1]) {
+            case 'n': o->n = atol(v); break;
+            case 'f': o->fanout = atof(v); break;
+            case 'g': o->generations = atoi(v); break;
+            case 'c': o->collapse = atof(v); break;
+            case 'd': o->dead = atof(v); break;
+            case 's': o->seed = strtoull(v, NULL, 10); break;
+            case 'q': o->samples = atol(v); break;
+            case 'Q': o->heavy_samples = atol(v); break;
+            case 'r': o->runs = atoi(v); break;
+            case 't': o->threads = atoi(v); break;
+            case 'o': o->path = v; break;
+            default: return -1;
+        }
+    }
+    if (o->n < 2 || o->fanout <= 0 || o->generations < 1 || o->runs < 1 ||
+        o->samples < 1 || o->heavy_samples < 1)
+        return -1;
+    rng_state = o->seed ? o->seed : 1;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions o;
+    if (parse_options(argc, argv, &o) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    double t0 = now_sec();
+    long people = 0, relations = 0;
+    if (generate_tree(&o, &people, &relations) != 0) {
+        fprintf(stderr, "Не удалось сгенерировать %s\n", o.path);
+        return 1;
+    }
+    double gen_time = now_sec() - t0;
+    fprintf(stderr, "Сгенерировано %s: людей %ld, связей %ld за %.3f с\n",
+            o.path, people, relations, gen_time);
+    if (o.generate_only) return 0;
+
+    // отчёт — в копию stdout, вывод самих операций — в NULL_DEVICE
+    FILE* out = fdopen(dup(fileno(stdout)), "w");
+    if (!out || !freopen(NULL_DEVICE, "w", stdout)) {
+        fprintf(stderr, "Не удалось перенаправить stdout\n");
+        return 1;
+    }
+    fprintf(out, "operation,samples,items,total_sec,items_per_sec,p50_us,p99_us,max_us\n");
+    report(out, "generate", &gen_time, 1, (double)people + relations);
+
+    long max_samples = o.samples > o.heavy_samples ? o.samples : o.heavy_samples;
+    if (max_samples < o.runs) max_samples = o.runs;
+    double* lat = malloc(sizeof(double) * max_samples);
+    if (!lat) return 1;
+
+    // загрузка
+    Graph* g = NULL;
+    LoadStats st = {0, 0, 0, 0};
+    for (int r = 0; r < o.runs; r++) {
+        if (g) free_graph(g);
+        g = create_graph();
+        if (!g) return 1;
+        t0 = now_sec();
+        load_from_file_parallel(o.path, g, &st, o.threads);
+        lat[r] = now_sec() - t0;
+    }
+    report(out, "load", lat, o.runs, (double)(st.persons + st.relations) * o.runs);
+
+    // проверка UTF-8 всего файла (items — байты)
+    MappedFile mf;
+    if (map_file(o.path, &mf) == 0) {
+        for (int r = 0; r < o.runs; r++) {
+            t0 = now_sec();
+            utf8_validate(mf.data, mf.size, NULL, 0);
+            lat[r] = now_sec() - t0;
+        }
+        report(out, "utf8_validate", lat, o.runs, (double)mf.size * o.runs);
+        unmap_file(&mf);
+    }
+
+    // поиск по имени
+    for (long i = 0; i < o.samples; i++) {
+        const char* name = random_name(g);
+        t0 = now_sec();
+        find_person_index(g, name);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "find_person_index", lat, o.samples, (double)o.samples);
+
+    // обходы
+    for (long i = 0; i < o.heavy_samples; i++) {
+        const char* name = random_name(g);
+        t0 = now_sec();
+        get_descendants(g, name);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "get_descendants", lat, o.heavy_samples, (double)o.heavy_samples);
+
+    // те же запросы без печати: индексы в буфере графа (items — найденные люди)
+    double relatives_found = 0;
+    for (long i = 0; i < o.heavy_samples; i++) {
+        const char* name = random_name(g);
+        int count;
+        t0 = now_sec();
+        relatives_view(g, name, 1, &count);
+        lat[i] = now_sec() - t0;
+        relatives_found += count;
+    }
+    report(out, "relatives_view", lat, o.heavy_samples, relatives_found);
+
+    // поколения потомков ранних людей: в одном потоке, пулом и с раскрытием снизу вверх
+    // (items — найденные люди)
+    const char* level_ops[] = { "get_generations", "get_generations_parallel", "get_generations_bottom_up" };
+    int pool_threads = o.threads > 0 ? o.threads : thread_pool_default_size();
+    for (int mode = 0; mode < 3; mode++) {
+        graph_set_traversal(g, mode == 0 ? 1 : pool_threads, mode == 2);
+        double found = 0;
+        for (long i = 0; i < o.heavy_samples; i++) {
+            const char* name = random_early_name(g);
+            GenerationLevels gl;
+            t0 = now_sec();
+            int rc = get_generations(g, name, 1, &gl);
+            lat[i] = now_sec() - t0;
+            if (rc == 0) {
+                found += gl.count;
+                free_generation_levels(&gl);
+            }
+        }
+        report(out, level_ops[mode], lat, o.heavy_samples, found);
+    }
+    graph_set_traversal(g, 1, 0);
+
+    for (long i = 0; i < o.heavy_samples; i++) {
+        const char* a = random_name(g);
+        const char* b = random_name(g);
+        t0 = now_sec();
+        shortest_relation_path(g, a, b);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "shortest_relation_path", lat, o.heavy_samples, (double)o.heavy_samples);
+
+    for (long i = 0; i < o.heavy_samples; i++) {
+        const char* name = random_name(g);
+        t0 = now_sec();
+        distribute_inheritance(g, name, 1000.0);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "distribute_inheritance", lat, o.heavy_samples, (double)o.heavy_samples);
+
+    // те же запросы пакетом через run_batch_queries: в одном потоке и пулом
+    // (замер — пакет целиком, items — запросы)
+    BatchQuery* queries = malloc(sizeof(BatchQuery) * o.heavy_samples);
+    BatchResult* results = malloc(sizeof(BatchResult) * o.heavy_samples);
+    if (!queries || !results) return 1;
+    for (long i = 0; i < o.heavy_samples; i++) {
+        queries[i].kind = i % 2 ? QUERY_INHERITANCE : QUERY_DISTANCE;
+        queries[i].from = random_name(g);
+        queries[i].to = random_name(g);
+        queries[i].amount = 1000.0;
+    }
+    const char* batch_ops[] = { "batch_queries", "batch_queries_parallel" };
+    for (int mode = 0; mode < 2; mode++) {
+        for (int r = 0; r < o.runs; r++) {
+            t0 = now_sec();
+            run_batch_queries(g, queries, results, o.heavy_samples, mode == 0 ? 1 : pool_threads);
+            lat[r] = now_sec() - t0;
+            free_batch_results(results, o.heavy_samples);
+        }
+        report(out, batch_ops[mode], lat, o.runs, (double)o.heavy_samples * o.runs);
+    }
+    free(queries);
+    free(results);
+
+    // поиск по имени: «Имя Фамилия», фамилия и полное имя без последней цифры номера
+    // (первый замер включает построение индекса имён; items — найденные люди)
+    const char* search_ops[] = { "search_names_prefix", "search_names_by_surname", "search_names_fuzzy" };
+    for (int op = 0; op < 3; op++) {
+        double found = 0;
+        for (long i = 0; i < o.heavy_samples; i++) {
+            char query[BENCH_MAX_NAME];
+            snprintf(query, sizeof(query), "%s", random_name(g));
+            char* first_space = strchr(query, ' ');
+            char* second_space = first_space ? strchr(first_space + 1, ' ') : NULL;
+            const char* text = query;
+            if (op == 0 && second_space) *second_space = '\0';
+            if (op == 1 && second_space) {
+                *second_space = '\0';
+                text = first_space + 1;
+            }
+            if (op == 2) query[strlen(query) - 1] = '\0';
+            int* ids;
+            int n;
+            t0 = now_sec();
+            if (op == 0) n = search_names_prefix(g, text, &ids);
+            else if (op == 1) n = search_names_by_surname(g, text, &ids);
+            else n = search_names_fuzzy(g, text, 1, &ids);
+            lat[i] = now_sec() - t0;
+            if (n >= 0) {
+                found += n;
+                free(ids);
+            }
+        }
+        report(out, search_ops[op], lat, o.heavy_samples, found);
+    }
+
+    // выборки по годам (items — просмотренные слоты)
+    int last_year = 1500 + 35 * (o.generations > 0 ? o.generations : 1);
+    for (long i = 0; i < o.heavy_samples; i++) {
+        t0 = now_sec();
+        count_alive(g);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "count_alive", lat, o.heavy_samples, (double)g->size * o.heavy_samples);
+
+    for (long i = 0; i < o.heavy_samples; i++) {
+        int from = 1500 + (int)rng_below(last_year - 1500);
+        int* ids;
+        t0 = now_sec();
+        if (filter_by_birth_range(g, from, from + 10, &ids) >= 0) free(ids);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "filter_by_birth_range", lat, o.heavy_samples, (double)g->size * o.heavy_samples);
+
+    for (long i = 0; i < o.heavy_samples; i++) {
+        int year = 1500 + (int)rng_below(last_year - 1500);
+        int* ids;
+        t0 = now_sec();
+        if (alive_in_year(g, year, &ids) >= 0) free(ids);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "alive_in_year", lat, o.heavy_samples, (double)g->size * o.heavy_samples);
+
+    // те же запросы по индексу отрезков жизни (первый замер включает построение индекса)
+    for (long i = 0; i < o.heavy_samples; i++) {
+        int year = 1500 + (int)rng_below(last_year - 1500);
+        int* ids;
+        t0 = now_sec();
+        if (lifespan_alive_in(g, year, &ids) >= 0) free(ids);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "lifespan_alive_in", lat, o.heavy_samples, (double)o.heavy_samples);
+
+    // экспорт
+    char dot_path[BENCH_MAX_NAME + 8];
+    snprintf(dot_path, sizeof(dot_path), "%.*s.dot", BENCH_MAX_NAME, o.path);
+    for (int r = 0; r < o.runs; r++) {
+        t0 = now_sec();
+        export_dot(g, dot_path);
+        lat[r] = now_sec() - t0;
+    }
+    remove(dot_path);
+    report(out, "export_dot", lat, o.runs, (double)g->edge_count * o.runs);
+
+    // изменения: новые люди, связи с ними, затем удаления
+    char name[BENCH_MAX_NAME];
+    long added = 0;
+    for (long i = 0; i < o.samples; i++) {
+        snprintf(name, sizeof(name), "Новый Человек %ld", i);
+        Person p = { name, (int)(i & 1) ? FEMALE : MALE, 1900, -1 };
+        t0 = now_sec();
+        if (add_person(g, p) >= 0) added++;
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "add_person", lat, o.samples, (double)added);
+
+    for (long i = 0; i < o.samples; i++) {
+        const char* parent = random_name(g);
+        snprintf(name, sizeof(name), "Новый Человек %ld", i);
+        t0 = now_sec();
+        add_relation(g, parent, name, PARENT);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "add_relation", lat, o.samples, (double)o.samples);
+
+    long removals = o.samples < g->live_count ? o.samples : g->live_count - 1;
+    for (long i = 0; i < removals; i++) {
+        const char* victim = random_name(g);
+        t0 = now_sec();
+        remove_person(g, victim);
+        lat[i] = now_sec() - t0;
+    }
+    report(out, "remove_person", lat, removals, (double)removals);
+
+    free(lat);
+    free_graph(g);
+    fclose(out);
+    if (!o.keep) remove(o.path);
+    return 0;
+}
@@ -1,176 +1,2756 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime для статистики (GRAPH_STATS) при -std=c11
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
 #include <math.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "graph.h"
+#include "utf8.h"
+#include <stdatomic.h>
+#ifdef GRAPH_STATS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#endif
 
 #define INITIAL_CAPACITY 10 // начальный размер массива вершин
-#define HASH_CAPACITY 1024 // размер хэш-таблицы для имён
-#define INF INT_MAX // это для заполнения изначальной матрицы расстояний
+#define HASH_INITIAL_CAPACITY 64 // начальный размер хэш-таблицы для имён (степень двойки)
+#define HASH_MAX_LOAD_PERCENT 70 // при большем заполнении (в процентах) таблица растёт вдвое
+#define ARENA_BLOCK_SIZE (64 * 1024) // размер блока арены
+#define ARENA_ALIGN sizeof(void*) // выравнивание выделяемых из арены объектов
+#define NAME_SMALL_CLASSES 32 // классы блоков имён с шагом ARENA_ALIGN; следующие — степени двойки
+#define SNAPSHOT_MAGIC "FAMSNAP" // сигнатура файла снимка (8 байт вместе с нулём)
+#define SNAPSHOT_VERSION 2 // версия формата снимка
+#define SNAPSHOT_BYTE_ORDER 0x01020304u // для проверки порядка байт
+#define SNAPSHOT_NO_NAME UINT64_MAX // смещение имени для удалённых слотов
+#define REMOVED_BIRTH_YEAR INT_MIN // год рождения удалённого слота в столбцах: его не выбирает ни один фильтр
+#define DELTA_NONE (-1) // слот отсутствует в индексе (IndexDelta.where)
+#define DELTA_BUILT (-2) // запись слота в построенном индексе действительна
+#define DELTA_MIN_DIRTY 256 // индекс перестраивается, когда изменений больше этого
+#define DELTA_DIRTY_SHARE 16 // ... и больше 1/16 от размера индекса
+#define NAME_SEARCH_MAX_LEN 128 // сколько символов имени учитывает поиск с опечатками
+#define NAME_RADIX_MIN 64       // меньшие группы ключей индекса имён сортируются qsort
+#define NAME_FUZZY_MAX_DISTANCE 3 // наибольшее допустимое число правок при поиске с опечатками
+#define LEVEL_CHUNK 1024 // вершин в одной задаче параллельного раскрытия уровня (кратно 64)
+#define LEVEL_PARALLEL_MIN_EDGES (1 << 15) // уровни с меньшим числом рёбер раскрываются в одном потоке
+#define LEVEL_BOTTOM_UP_MIN 4096 // уровни уже этого не раскрываются снизу вверх
+#define LEVEL_ALPHA 14 // снизу вверх, когда рёбер уровня больше 1/14 ещё не проверенных
+#define LEVEL_BETA 24 // обратно сверху вниз, когда уровень меньше 1/24 вершин графа
+#define REACH_BITSET_MAX_BYTES (256u * 1024 * 1024) // предел памяти под полное транзитивное замыкание
+
+#define DOT_BUFFER_SIZE (1 << 20) // буфер экспорта в DOT
+#define PRINT_BUFFER_SIZE (64 * 1024) // буфер печати списков людей
+#define STAT_BUCKETS 40 // корзины гистограмм статистики: [2^k, 2^(k+1))
+#define STAT_PROBE_BUCKETS 16 // длины проб хэш-таблицы 1..15 и «16 и больше»
+#define STAT_ENV "GRAPH_STATS_DUMP" // переменная окружения: печать статистики при выходе
 
 #define RED        "\x1b[1;31m"
 #define CYAN       "\x1b[1;36m"
 #define RESET      "\x1b[0m"
 
 
-// --- Очередь для BFS --- //
-// Каждый узел очереди — элемент связного списка
-typedef struct QueueNode {
-    int index;                // Индекс вершины в графе
-    struct QueueNode* next;  // Указатель на следующий элемент в очереди
-} QueueNode;
+// ----------- Статистика операций -------------- //
+// Собирается только при сборке с -DGRAPH_STATS; иначе макросы ниже пусты.
+// Счётчики атомарные: поиск имён идёт параллельно при загрузке и в пакетных запросах.
+#ifdef GRAPH_STATS
+typedef enum {
+    OP_ADD_PERSON, OP_ADD_RELATION, OP_REMOVE_RELATION, OP_REMOVE_PERSON,
+    OP_FIND_PERSON, OP_GET_DESCENDANTS, OP_GET_ANCESTORS, OP_FIND_KINSHIP,
+    OP_IS_DESCENDANT, OP_SHORTEST_PATH, OP_INHERITANCE, OP_BATCH_QUERY,
+    OP_PRINT_GRAPH, OP_EXPORT_DOT, OP_SAVE_SNAPSHOT, OP_LOAD_SNAPSHOT,
+    OP_FILTER_PEOPLE, OP_LIFESPAN_QUERY, OP_SEARCH_NAMES, OP_GET_GENERATIONS,
+    OP_COUNT
+} StatOp;
+
+static const char* const stat_op_names[OP_COUNT] = {
+    "add_person", "add_relation", "remove_relation", "remove_person",
+    "find_person_index", "get_descendants", "get_ancestors", "find_kinship",
+    "is_descendant", "shortest_relation_path", "distribute_inheritance", "batch_query",
+    "print_graph", "export_dot", "save_snapshot", "load_snapshot", "filter_people",
+    "lifespan_query", "search_names", "get_generations"
+};
+
+typedef enum {
+    CNT_ARENA_BLOCKS, CNT_ARENA_BYTES, CNT_EDGE_ALLOCS, CNT_EDGE_REUSES, CNT_NAME_REUSES,
+    CNT_VERTEX_GROWS, CNT_HASH_RESIZES, CNT_CSR_BUILDS, CNT_KINSHIP_BUILDS,
+    CNT_REACH_BUILDS, CNT_LIFESPAN_BUILDS, CNT_NAME_INDEX_BUILDS,
+    CNT_PARALLEL_LEVELS, CNT_BOTTOM_UP_LEVELS,
+    CNT_COUNT
+} StatCounter;
+
+static const char* const stat_counter_names[CNT_COUNT] = {
+    "блоков арены", "байт в блоках арены", "рёбер из арены", "рёбер повторно", "имён повторно",
+    "расширений массива вершин", "расширений хэш-таблицы", "перестроений CSR",
+    "построений индекса родства", "построений индекса достижимости",
+    "построений индекса отрезков жизни", "построений индекса имён",
+    "уровней обхода в пуле потоков", "уровней обхода снизу вверх"
+};
+
+// Статистика одной операции API
+typedef struct {
+    _Atomic unsigned long long calls;                    // Количество вызовов
+    _Atomic unsigned long long ns;                       // Суммарное время, нс
+    _Atomic unsigned long long max_ns;                   // Самый долгий вызов, нс
+    _Atomic unsigned long long edges;                    // Просмотрено рёбер за все вызовы
+    _Atomic unsigned long long time_hist[STAT_BUCKETS];  // Гистограмма времени
+    _Atomic unsigned long long edge_hist[STAT_BUCKETS];  // Гистограмма рёбер на вызов
+} OpStats;
+
+static OpStats stat_ops[OP_COUNT];
+static _Atomic unsigned long long stat_counters[CNT_COUNT];
+static _Atomic unsigned long long stat_probe_hist[STAT_PROBE_BUCKETS];
+static _Atomic unsigned long long stat_probe_total;
+// рёбра, просмотренные текущим потоком (вызов берёт разность на входе и выходе)
+static _Thread_local unsigned long long stat_edges;
+
+// Замер одного вызова; закрывается автоматически при выходе из области видимости
+typedef struct {
+    StatOp op;
+    unsigned long long start;
+    unsigned long long edges;
+} StatScope;
+
+static unsigned long long stat_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (unsigned long long)(t.QuadPart / freq.QuadPart) * 1000000000ULL
+         + (unsigned long long)(t.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// Номер корзины: floor(log2(v)), 0 — для v <= 1
+static int stat_bucket(unsigned long long v) {
+    int b = v > 1 ? 63 - __builtin_clzll(v) : 0;
+    return b < STAT_BUCKETS ? b : STAT_BUCKETS - 1;
+}
+
+static void stat_add(_Atomic unsigned long long* c, unsigned long long n) {
+    atomic_fetch_add_explicit(c, n, memory_order_relaxed);
+}
+
+static StatScope stat_scope_begin(StatOp op) {
+    StatScope s = { op, stat_now(), stat_edges };
+    return s;
+}
+
+static void stat_scope_end(StatScope* s) {
+    unsigned long long ns = stat_now() - s->start;
+    unsigned long long edges = stat_edges - s->edges;
+    OpStats* st = &stat_ops[s->op];
+    stat_add(&st->calls, 1);
+    stat_add(&st->ns, ns);
+    stat_add(&st->time_hist[stat_bucket(ns)], 1);
+    stat_add(&st->edges, edges);
+    stat_add(&st->edge_hist[stat_bucket(edges)], 1);
+    unsigned long long cur = atomic_load_explicit(&st->max_ns, memory_order_relaxed);
+    while (ns > cur && !atomic_compare_exchange_weak_explicit(&st->max_ns, &cur, ns,
+                                                              memory_order_relaxed,
+                                                              memory_order_relaxed)) {}
+}
+
+static void stat_probes(unsigned long probes) {
+    stat_add(&stat_probe_hist[probes < STAT_PROBE_BUCKETS ? probes - 1 : STAT_PROBE_BUCKETS - 1], 1);
+    stat_add(&stat_probe_total, probes);
+}
+
+#define STAT_SCOPE(op) \
+    StatScope stat_scope_ __attribute__((cleanup(stat_scope_end))) = stat_scope_begin(op)
+#define STAT_EDGES(n) (stat_edges += (unsigned long long)(n))
+#define STAT_COUNT(c, n) stat_add(&stat_counters[c], (unsigned long long)(n))
+#define STAT_PROBES(n) stat_probes(n)
+
+// Верхняя граница корзины, в которую попадает доля q замеров гистограммы
+// (не больше limit — известного максимума)
+static unsigned long long stat_quantile(_Atomic unsigned long long* hist, unsigned long long total,
+                                        double q, unsigned long long limit) {
+    unsigned long long need = (unsigned long long)(total * q), seen = 0, bound = limit;
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        seen += atomic_load_explicit(&hist[b], memory_order_relaxed);
+        if (seen > need) {
+            bound = 2ULL << b;
+            break;
+        }
+    }
+    return bound < limit ? bound : limit;
+}
+
+void graph_stats_dump(FILE* out) {
+    if (!out) out = stdout;
+    fprintf(out, "=== Статистика операций ===\n");
+    // заголовок выровнен по символам (printf считает байты, а UTF-8 кириллица — по два)
+    fprintf(out, "%s\n", "операция                    вызовов    всего, мс среднее, мкс   p50 <, мкс   p99 <, мкс    макс, мкс          рёбер  p99 рёбер");
+    for (int i = 0; i < OP_COUNT; i++) {
+        OpStats* st = &stat_ops[i];
+        unsigned long long calls = atomic_load_explicit(&st->calls, memory_order_relaxed);
+        if (calls == 0) continue;
+        unsigned long long ns = atomic_load_explicit(&st->ns, memory_order_relaxed);
+        unsigned long long max_ns = atomic_load_explicit(&st->max_ns, memory_order_relaxed);
+        unsigned long long edges = atomic_load_explicit(&st->edges, memory_order_relaxed);
+        fprintf(out, "%-24s %10llu %12.3f %12.3f %12.3f %12.3f %12.3f %14llu %10llu\n",
+                stat_op_names[i], calls, ns / 1e6, ns / 1e3 / calls,
+                stat_quantile(st->time_hist, calls, 0.50, max_ns) / 1e3,
+                stat_quantile(st->time_hist, calls, 0.99, max_ns) / 1e3,
+                max_ns / 1e3, edges,
+                stat_quantile(st->edge_hist, calls, 0.99, edges));
+    }
+    unsigned long long lookups = 0;
+    for (int b = 0; b < STAT_PROBE_BUCKETS; b++)
+        lookups += atomic_load_explicit(&stat_probe_hist[b], memory_order_relaxed);
+    unsigned long long probes = atomic_load_explicit(&stat_probe_total, memory_order_relaxed);
+    fprintf(out, "Поиск имён: %llu, в среднем проб: %.3f\n", lookups,
+            lookups ? (double)probes / lookups : 0.0);
+    fprintf(out, "Длины проб:");
+    for (int b = 0; b < STAT_PROBE_BUCKETS; b++) {
+        unsigned long long c = atomic_load_explicit(&stat_probe_hist[b], memory_order_relaxed);
+        if (c) fprintf(out, " %d%s:%llu", b + 1, b == STAT_PROBE_BUCKETS - 1 ? "+" : "", c);
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i < CNT_COUNT; i++)
+        fprintf(out, "%s: %llu\n", stat_counter_names[i],
+                atomic_load_explicit(&stat_counters[i], memory_order_relaxed));
+    fflush(out);
+}
+
+void graph_stats_reset(void) {
+    for (int i = 0; i < OP_COUNT; i++) {
+        OpStats* st = &stat_ops[i];
+        atomic_store(&st->calls, 0);
+        atomic_store(&st->ns, 0);
+        atomic_store(&st->max_ns, 0);
+        atomic_store(&st->edges, 0);
+        for (int b = 0; b < STAT_BUCKETS; b++) {
+            atomic_store(&st->time_hist[b], 0);
+            atomic_store(&st->edge_hist[b], 0);
+        }
+    }
+    for (int i = 0; i < CNT_COUNT; i++) atomic_store(&stat_counters[i], 0);
+    for (int b = 0; b < STAT_PROBE_BUCKETS; b++) atomic_store(&stat_probe_hist[b], 0);
+    atomic_store(&stat_probe_total, 0);
+}
+
+// Печать при выходе: значение STAT_ENV "1" или "stderr" — в stderr, иначе — путь к файлу
+static void stat_dump_at_exit(void) {
+    const char* target = getenv(STAT_ENV);
+    if (!target) return;
+    if (strcmp(target, "1") == 0 || strcmp(target, "stderr") == 0) {
+        graph_stats_dump(stderr);
+        return;
+    }
+    FILE* f = fopen(target, "a");
+    if (!f) return;
+    graph_stats_dump(f);
+    fclose(f);
+}
+
+static void stat_register_exit(void) {
+    static int registered = 0;
+    const char* target = getenv(STAT_ENV);
+    if (registered || !target || !*target || strcmp(target, "0") == 0) return;
+    registered = 1;
+    atexit(stat_dump_at_exit);
+}
+#else
+#define STAT_SCOPE(op) ((void)0)
+#define STAT_EDGES(n) ((void)0)
+#define STAT_COUNT(c, n) ((void)0)
+#define STAT_PROBES(n) ((void)0)
+
+void graph_stats_dump(FILE* out) {
+    fprintf(out ? out : stdout, "Статистика отключена (сборка без -DGRAPH_STATS)\n");
+}
+
+void graph_stats_reset(void) {}
+
+static void stat_register_exit(void) {}
+#endif
+
+
+// ----------- Арена -------------- //
+static void* arena_alloc(Arena* a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ArenaBlock* b = a->head;
+    if (!b || b->capacity - b->used < size) {
+        // крупные запросы получают собственный блок
+        size_t cap = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        size_t header = (sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        b = malloc(header + cap);
+        if (!b) return NULL;
+        STAT_COUNT(CNT_ARENA_BLOCKS, 1);
+        STAT_COUNT(CNT_ARENA_BYTES, header + cap);
+        b->used = header;
+        b->capacity = header + cap;
+        b->next = a->head;
+        a->head = b;
+    }
+    void* p = (char*)b + b->used;
+    b->used += size;
+    return p;
+}
+
+static void arena_free(Arena* a) {
+    ArenaBlock* b = a->head;
+    while (b) { ArenaBlock* tmp = b; b = b->next; free(tmp); }
+    a->head = NULL;
+}
+
+// Рёбра выделяются из арены; удалённые складываются в список свободных
+static Edge* edge_alloc(Graph* g) {
+    Edge* e = g->free_edges;
+    if (e) {
+        g->free_edges = e->next;
+        STAT_COUNT(CNT_EDGE_REUSES, 1);
+        return e;
+    }
+    STAT_COUNT(CNT_EDGE_ALLOCS, 1);
+    return arena_alloc(&g->arena, sizeof(Edge));
+}
+
+static void edge_release(Graph* g, Edge* e) {
+    e->next = g->free_edges;
+    g->free_edges = e;
+}
+
+// Класс размеров блока для строки из size байт; *block — размер блока.
+// @return Номер класса или -1, если строка длиннее самого большого класса.
+static int name_class(size_t size, size_t* block) {
+    size_t units = (size + ARENA_ALIGN - 1) / ARENA_ALIGN;
+    if (units <= NAME_SMALL_CLASSES) {
+        *block = units * ARENA_ALIGN;
+        return (int)units - 1;
+    }
+    size_t b = NAME_SMALL_CLASSES * ARENA_ALIGN;
+    int c = NAME_SMALL_CLASSES - 1;
+    while (b < size && c < NAME_CLASS_COUNT) {
+        b *= 2;
+        c++;
+    }
+    *block = c < NAME_CLASS_COUNT ? b : size;
+    return c < NAME_CLASS_COUNT ? c : -1;
+}
+
+// Копия имени: блок из списка свободных своего класса или новый из арены
+static char* name_alloc(Graph* g, const char* s) {
+    size_t len = strlen(s) + 1, block;
+    int c = name_class(len, &block);
+    char* p = c >= 0 ? g->names.free[c] : NULL;
+    if (p) {
+        g->names.free[c] = *(void**)p;
+        STAT_COUNT(CNT_NAME_REUSES, 1);
+    } else {
+        p = arena_alloc(&g->arena, block);
+    }
+    if (p) memcpy(p, s, len);
+    return p;
+}
+
+// Возвращает блок имени в список свободных его класса
+static void name_free(NamePool* np, char* name) {
+    size_t block;
+    int c = name_class(strlen(name) + 1, &block);
+    if (c < 0) return;
+    *(void**)name = np->free[c];
+    np->free[c] = name;
+}
+
+// Имя удалённого человека. Имена из снимка лежат в отображённом файле и не
+// переиспользуются; индекс имён хранит свои свёрнутые копии и на имена не ссылается.
+static void name_release(Graph* g, char* name) {
+    const char* data = g->snapshot.data;
+    if (data && name >= data && name < data + g->snapshot.size) return;
+    name_free(&g->names, name);
+}
+
+
+// ----------- Хэш-таблица -------------- //
+static unsigned long hash_bytes(const char* str, size_t len) {
+    unsigned long hash = 5381;
+    for (size_t i = 0; i < len; i++)
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+    // перемешиваем биты, чтобы младшие разряды (по ним берётся ячейка) были равномерны
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bUL;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static unsigned long hash_string(const char* str) {
+    return hash_bytes(str, strlen(str));
+}
+
+// Массив пустых ячеек
+static NameHashSlot* name_slots_alloc(int capacity) {
+    NameHashSlot* slots = malloc(sizeof(NameHashSlot) * capacity);
+    if (!slots) return NULL;
+    for (int i = 0; i < capacity; i++) {
+        slots[i].hash = 0;
+        slots[i].index = -1;
+    }
+    return slots;
+}
+
+// Ключ занятой ячейки — имя её вершины
+static const char* slot_key(const NameHashTable* ht, const NameHashSlot* s) {
+    return (*ht->vertices)[s->index].name;
+}
+
+static NameHashTable* create_name_table(Vertex* const* vertices) {
+    NameHashTable* ht = malloc(sizeof(NameHashTable));
+    if (!ht) return NULL;
+    ht->capacity = HASH_INITIAL_CAPACITY;
+    ht->count = 0;
+    ht->vertices = vertices;
+    ht->mapped = 0;
+    ht->slots = name_slots_alloc(ht->capacity);
+    if (!ht->slots) { free(ht); return NULL; }
+    return ht;
+}
+
+static void free_name_table(NameHashTable* ht) {
+    if (!ht) return;
+    if (!ht->mapped) free(ht->slots);
+    free(ht);
+}
+
+// Перераспределяет ячейки в таблицу нового размера (хэши не пересчитываются)
+static int name_table_resize(NameHashTable* ht, int new_capacity) {
+    NameHashSlot* slots = name_slots_alloc(new_capacity);
+    if (!slots) return -1;
+    STAT_COUNT(CNT_HASH_RESIZES, 1);
+    unsigned long mask = (unsigned long)new_capacity - 1;
+    for (int i = 0; i < ht->capacity; i++) {
+        NameHashSlot* s = &ht->slots[i];
+        if (s->index < 0) continue;
+        unsigned long pos = s->hash & mask;
+        while (slots[pos].index >= 0) pos = (pos + 1) & mask;
+        slots[pos] = *s;
+    }
+    if (!ht->mapped) free(ht->slots);
+    ht->slots = slots;
+    ht->capacity = new_capacity;
+    ht->mapped = 0;
+    return 0;
+}
+
+// Добавляет ключ name для вершины index (её имя может быть ещё не записано)
+static int name_table_insert(NameHashTable* ht, const char* name, int index) {
+    if (!ht || !name) return -1;
+    if ((long)(ht->count + 1) * 100 > (long)ht->capacity * HASH_MAX_LOAD_PERCENT
+        && name_table_resize(ht, ht->capacity * 2) != 0)
+        return -1;
+    unsigned long h = hash_string(name);
+    unsigned long mask = (unsigned long)ht->capacity - 1;
+    unsigned long pos = h & mask;
+    while (ht->slots[pos].index >= 0) {
+        if (ht->slots[pos].hash == h && strcmp(slot_key(ht, &ht->slots[pos]), name) == 0)
+            return -1; // дубликат, выходим
+        pos = (pos + 1) & mask; // идём к следующей ячейке
+    }
+    ht->slots[pos].hash = h;
+    ht->slots[pos].index = index;
+    ht->count++;
+    return 0;
+}
+
+// Поиск по ключу, заданному длиной (не обязательно завершённому нулём)
+static int name_table_find_n(NameHashTable* ht, const char* name, size_t len) {
+    if (!ht || !name) return -1;
+    unsigned long h = hash_bytes(name, len);
+    unsigned long mask = (unsigned long)ht->capacity - 1;
+    unsigned long pos = h & mask;
+    while (ht->slots[pos].index >= 0) {
+        if (ht->slots[pos].hash == h) {
+            const char* key = slot_key(ht, &ht->slots[pos]);
+            if (strncmp(key, name, len) == 0 && key[len] == '\0') {
+                STAT_PROBES(((pos - (h & mask)) & mask) + 1);
+                return ht->slots[pos].index;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    STAT_PROBES(((pos - (h & mask)) & mask) + 1);
+    return -1;
+}
+
+static int name_table_find(NameHashTable* ht, const char* name) {
+    if (!ht || !name) return -1;
+    return name_table_find_n(ht, name, strlen(name));
+}
+
+// Заранее увеличивает таблицу так, чтобы extra новых ключей не вызвали роста
+static int name_table_reserve(NameHashTable* ht, int extra) {
+    long need = (long)ht->count + extra;
+    int cap = ht->capacity;
+    while (need * 100 > (long)cap * HASH_MAX_LOAD_PERCENT) cap *= 2;
+    return cap == ht->capacity ? 0 : name_table_resize(ht, cap);
+}
+
+// Удаляет ключ со сдвигом следующих элементов кластера назад (без «надгробий»)
+static int name_table_remove(NameHashTable* ht, const char* name) {
+    if (!ht || !name) return -1;
+    unsigned long h = hash_string(name);
+    unsigned long mask = (unsigned long)ht->capacity - 1;
+    unsigned long pos = h & mask;
+    while (ht->slots[pos].index >= 0) {
+        if (ht->slots[pos].hash == h && strcmp(slot_key(ht, &ht->slots[pos]), name) == 0)
+            break;
+        pos = (pos + 1) & mask;
+    }
+    if (ht->slots[pos].index < 0) return -1;
+    unsigned long hole = pos;
+    unsigned long next = (pos + 1) & mask;
+    while (ht->slots[next].index >= 0) {
+        unsigned long home = ht->slots[next].hash & mask;
+        // элемент можно перенести в дыру, если его «домашняя» ячейка не лежит
+        // циклически между дырой и его текущей позицией
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            ht->slots[hole] = ht->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    ht->slots[hole].index = -1;
+    ht->count--;
+    return 0;
+}
+
+
+// ----------- CSR-снимок -------------- //
+// Помечает устаревшими все производные структуры (снимок, индексы, кэш запросов)
+static void graph_invalidate(Graph* g) {
+    g->version++;
+    g->csr.valid = 0;
+    g->kinship.valid = 0;
+    g->kinship.cyclic = 0;
+    g->reach.valid = 0;
+    g->reach.cyclic = 0;
+}
+
+static void csr_free(CsrView* csr) {
+    if (!csr->mapped) {
+        free(csr->offsets);
+        free(csr->to);
+        free(csr->relation);
+        free(csr->in_offsets);
+        free(csr->in_from);
+        free(csr->in_relation);
+    }
+    memset(csr, 0, sizeof(CsrView));
+}
+
+// Переносит связные списки рёбер в непрерывные массивы (буферы переиспользуются;
+// массивы из снимка остаются в файле, вместо них выделяются новые)
+static int csr_build(Graph* g) {
+    CsrView* csr = &g->csr;
+    if (csr->mapped) csr_free(csr);
+    int n = g->size;
+    int m = g->edge_count;
+    if (n > csr->vertex_capacity || !csr->offsets) {
+        int* tmp = realloc(csr->offsets, sizeof(int) * (n + 1));
+        if (!tmp) return -1;
+        csr->offsets = tmp;
+        tmp = realloc(csr->in_offsets, sizeof(int) * (n + 1));
+        if (!tmp) return -1;
+        csr->in_offsets = tmp;
+        csr->vertex_capacity = n;
+    }
+    if (m > csr->edge_capacity || !csr->to) {
+        int cap = m > 0 ? m : 1;
+        int* to = realloc(csr->to, sizeof(int) * cap);
+        if (!to) return -1;
+        csr->to = to;
+        unsigned char* rel = realloc(csr->relation, cap);
+        if (!rel) return -1;
+        csr->relation = rel;
+        int* from = realloc(csr->in_from, sizeof(int) * cap);
+        if (!from) return -1;
+        csr->in_from = from;
+        unsigned char* in_rel = realloc(csr->in_relation, cap);
+        if (!in_rel) return -1;
+        csr->in_relation = in_rel;
+        csr->edge_capacity = cap;
+    }
+    STAT_COUNT(CNT_CSR_BUILDS, 1);
+    int pos = 0;
+    for (int i = 0; i < n; i++) {
+        csr->offsets[i] = pos;
+        for (Edge* e = g->vertices[i].edges; e; e = e->next) {
+            csr->to[pos] = e->to;
+            csr->relation[pos] = (unsigned char)e->relation;
+            pos++;
+        }
+    }
+    csr->offsets[n] = pos;
+    // обратные рёбра: считаем входящие степени, затем раскладываем по префиксным суммам
+    memset(csr->in_offsets, 0, sizeof(int) * (n + 1));
+    for (int k = 0; k < pos; k++) csr->in_offsets[csr->to[k] + 1]++;
+    for (int i = 0; i < n; i++) csr->in_offsets[i + 1] += csr->in_offsets[i];
+    for (int i = 0; i < n; i++) {
+        for (int k = csr->offsets[i]; k < csr->offsets[i + 1]; k++) {
+            int slot = csr->in_offsets[csr->to[k]]++;
+            csr->in_from[slot] = i;
+            csr->in_relation[slot] = csr->relation[k];
+        }
+    }
+    // после раскладки in_offsets[i] указывает на конец списка i — сдвигаем обратно
+    for (int i = n; i > 0; i--) csr->in_offsets[i] = csr->in_offsets[i - 1];
+    csr->in_offsets[0] = 0;
+    csr->vertex_count = n;
+    csr->edge_count = pos;
+    csr->valid = 1;
+    return 0;
+}
+
+// Возвращает актуальный снимок, при необходимости перестраивая его
+static const CsrView* graph_view(Graph* g) {
+    if (!g->csr.valid && csr_build(g) != 0) return NULL;
+    return &g->csr;
+}
+
+// Строит списки рёбер по CSR из снимка. Обходы работают по CSR, поэтому load_snapshot
+// списки не строит: они нужны только перед первым изменением связей или людей.
+// Порядок рёбер в списках совпадает с порядком в CSR.
+static int edges_materialize(Graph* g) {
+    if (!g->edges_pending) return 0;
+    const CsrView* csr = &g->csr;
+    int n = csr->vertex_count;
+    int m = csr->edge_count;
+    Edge* edges = m > 0 ? arena_alloc(&g->arena, sizeof(Edge) * (size_t)m) : NULL;
+    if (m > 0 && !edges) return -1;
+    for (int i = n - 1; i >= 0; i--) {
+        for (int k = csr->offsets[i + 1] - 1; k >= csr->offsets[i]; k--) {
+            Edge* e = &edges[k];
+            e->from = i;
+            e->to = csr->to[k];
+            e->relation = csr->relation[k] == CHILD ? CHILD : PARENT;
+            e->next = g->vertices[i].edges;
+            g->vertices[i].edges = e;
+            e->next_in = g->vertices[e->to].in_edges;
+            g->vertices[e->to].in_edges = e;
+        }
+    }
+    g->edges_pending = 0;
+    return 0;
+}
+
+// ----------- Буферы поиска -------------- //
+static void scratch_free(SearchScratch* sc) {
+    free(sc->mark_fwd);
+    free(sc->mark_bwd);
+    free(sc->dist_fwd);
+    free(sc->dist_bwd);
+    free(sc->queue_fwd);
+    free(sc->queue_bwd);
+    memset(sc, 0, sizeof(SearchScratch));
+}
+
+// Готовит буферы на n вершин и начинает новый запрос (новая метка)
+static int scratch_begin(SearchScratch* sc, int n) {
+    if (n > sc->capacity) {
+        int cap = sc->capacity ? sc->capacity : INITIAL_CAPACITY;
+        while (cap < n) cap *= 2;
+        scratch_free(sc);
+        sc->mark_fwd = calloc(cap, sizeof(unsigned int));
+        sc->mark_bwd = calloc(cap, sizeof(unsigned int));
+        sc->dist_fwd = malloc(sizeof(int) * cap);
+        sc->dist_bwd = malloc(sizeof(int) * cap);
+        sc->queue_fwd = malloc(sizeof(int) * cap);
+        sc->queue_bwd = malloc(sizeof(int) * cap);
+        if (!sc->mark_fwd || !sc->mark_bwd || !sc->dist_fwd || !sc->dist_bwd
+            || !sc->queue_fwd || !sc->queue_bwd) {
+            scratch_free(sc);
+            return -1;
+        }
+        sc->capacity = cap;
+    }
+    if (++sc->stamp == 0) {
+        // метка переполнилась — один раз очищаем массивы
+        memset(sc->mark_fwd, 0, sizeof(unsigned int) * sc->capacity);
+        memset(sc->mark_bwd, 0, sizeof(unsigned int) * sc->capacity);
+        sc->stamp = 1;
+    }
+    return 0;
+}
+
+int graph_freeze(Graph* g) {
+    if (!g) return -1;
+    return graph_view(g) ? 0 : -1;
+}
+
+void graph_thaw(Graph* g) {
+    if (!g) return;
+    // пока списки рёбер не построены, связи есть только в снимке
+    if (edges_materialize(g) != 0) return;
+    csr_free(&g->csr);
+}
+
+
+// ----------- Обход по уровням -------------- //
+// Вершины уровня лежат в order подряд, следующий уровень дописывается за ним.
+// Широкий уровень делится на куски по LEVEL_CHUNK вершин, которые раскрывает пул:
+// сначала каждая новая вершина закрепляется за ребром с наименьшим рангом (рёбра
+// нумеруются в порядке однопоточного обхода), затем куски считают свои вершины и
+// записывают их на места, найденные префиксной суммой. Поэтому порядок совпадает
+// с однопоточным обходом.
+typedef enum {
+    LEVEL_CLAIM,  // Закрепить новые вершины за рёбрами (сверху вниз)
+    LEVEL_COUNT,  // Посчитать вершины следующего уровня в каждом куске
+    LEVEL_WRITE   // Записать их в order
+} LevelPhase;
+
+// Задание для исполнителей одного уровня
+typedef struct {
+    LevelTraversal* lt;
+    const int* offs;              // Рёбра в направлении обхода
+    const int* adj;
+    const unsigned char* rel;
+    const int* back_offs;         // Рёбра в обратном направлении (для раскрытия снизу вверх)
+    const int* back_adj;
+    const unsigned char* back_rel;
+    LevelPhase phase;
+    int bottom_up;                // 1 — куски нарезаются из всех вершин графа
+    int begin, end;               // Текущий уровень в order
+    int n;                        // Количество вершин графа
+    long examined;                // Рёбра, проверенные снизу вверх (складываются атомарно)
+} LevelContext;
+
+static void level_free(LevelTraversal* lt) {
+    free(lt->order);
+    free(lt->level_start);
+    free(lt->claim);
+    free(lt->rank);
+    free(lt->chunk_count);
+    free(lt->visited);
+    free(lt->in_frontier);
+    lt->order = lt->level_start = lt->claim = lt->rank = lt->chunk_count = NULL;
+    lt->visited = lt->in_frontier = NULL;
+    lt->levels = 0;
+    lt->capacity = 0;
+}
+
+// Готовит буферы на n вершин; настройки обхода сохраняются
+static int level_reserve(LevelTraversal* lt, int n) {
+    if (n <= lt->capacity) return 0;
+    int cap = lt->capacity ? lt->capacity : INITIAL_CAPACITY;
+    while (cap < n) cap *= 2;
+    level_free(lt);
+    size_t words = ((size_t)cap + 63) / 64;
+    lt->order = malloc(sizeof(int) * cap);
+    lt->level_start = malloc(sizeof(int) * ((size_t)cap + 1));
+    lt->claim = malloc(sizeof(int) * cap);
+    lt->rank = malloc(sizeof(int) * cap);
+    lt->chunk_count = malloc(sizeof(int) * (cap / LEVEL_CHUNK + 1));
+    lt->visited = calloc(words, sizeof(uint64_t));
+    lt->in_frontier = calloc(words, sizeof(uint64_t));
+    if (!lt->order || !lt->level_start || !lt->claim || !lt->rank || !lt->chunk_count
+        || !lt->visited || !lt->in_frontier) {
+        level_free(lt);
+        return -1;
+    }
+    for (int i = 0; i < cap; i++) lt->claim[i] = INT_MAX;
+    lt->capacity = cap;
+    return 0;
+}
+
+static int bit_test(const uint64_t* bits, int v) {
+    return (int)((bits[v >> 6] >> (v & 63)) & 1);
+}
+
+// Слово битов делят вершины разных кусков, поэтому установка атомарная
+static void bit_set_atomic(uint64_t* bits, int v) {
+    atomic_fetch_or_explicit((_Atomic uint64_t*)&bits[v >> 6], (uint64_t)1 << (v & 63),
+                             memory_order_relaxed);
+}
+
+static void claim_min(int* slot, int rank) {
+    _Atomic int* a = (_Atomic int*)slot;
+    int cur = atomic_load_explicit(a, memory_order_relaxed);
+    while (rank < cur && !atomic_compare_exchange_weak_explicit(a, &cur, rank, memory_order_relaxed,
+                                                                memory_order_relaxed)) {}
+}
+
+// Есть ли у v сосед из текущего уровня по обратным рёбрам PARENT; проверенные рёбра
+// прибавляются к *examined
+static int has_frontier_neighbour(const LevelContext* c, int v, long* examined) {
+    for (int k = c->back_offs[v]; k < c->back_offs[v + 1]; k++) {
+        if (c->back_rel[k] == PARENT && bit_test(c->lt->in_frontier, c->back_adj[k])) {
+            *examined += k - c->back_offs[v] + 1;
+            return 1;
+        }
+    }
+    *examined += c->back_offs[v + 1] - c->back_offs[v];
+    return 0;
+}
+
+static void level_task(void* arg, int worker, long chunk) {
+    (void)worker;
+    LevelContext* c = arg;
+    LevelTraversal* lt = c->lt;
+    int* dst = c->phase == LEVEL_WRITE ? lt->order + lt->chunk_count[chunk] : NULL;
+    int count = 0;
+    if (c->bottom_up) {
+        // кусок кратен 64 вершинам, так что слова visited делить не с кем
+        int lo = (int)chunk * LEVEL_CHUNK;
+        int hi = lo + LEVEL_CHUNK < c->n ? lo + LEVEL_CHUNK : c->n;
+        long examined = 0;
+        for (int v = lo; v < hi; v++) {
+            if (bit_test(lt->visited, v) || !has_frontier_neighbour(c, v, &examined)) continue;
+            if (dst) {
+                dst[count] = v;
+                bit_set_atomic(lt->visited, v);
+            }
+            count++;
+        }
+        // проход записи повторяет проход подсчёта, поэтому рёбра учитываются один раз
+        if (!dst) {
+            lt->chunk_count[chunk] = count;
+            atomic_fetch_add_explicit((_Atomic long*)&c->examined, examined, memory_order_relaxed);
+        }
+        return;
+    }
+    int lo = c->begin + (int)chunk * LEVEL_CHUNK;
+    int hi = lo + LEVEL_CHUNK < c->end ? lo + LEVEL_CHUNK : c->end;
+    for (int i = lo; i < hi; i++) {
+        int u = lt->order[i];
+        int rank = lt->rank[i - c->begin] - c->offs[u];
+        for (int k = c->offs[u]; k < c->offs[u + 1]; k++) {
+            if (c->rel[k] != PARENT) continue;
+            int v = c->adj[k];
+            if (c->phase == LEVEL_CLAIM) {
+                if (!bit_test(lt->visited, v)) claim_min(&lt->claim[v], rank + k);
+                continue;
+            }
+            // ранги растут от уровня к уровню, так что закрепление с прошлых уровней не совпадёт
+            if (lt->claim[v] != rank + k) continue;
+            if (dst) dst[count] = v;
+            else bit_set_atomic(lt->visited, v);
+            count++;
+        }
+    }
+    if (!dst && c->phase == LEVEL_COUNT) lt->chunk_count[chunk] = count;
+}
+
+static void level_run(ThreadPool* pool, LevelContext* c, int chunks, LevelPhase phase) {
+    c->phase = phase;
+    if (pool) thread_pool_run(pool, chunks, level_task, c);
+    else for (int i = 0; i < chunks; i++) level_task(c, 0, i);
+}
+
+// Раскрывает уровень кусками; возвращает конец следующего уровня в order
+static int level_expand_chunks(ThreadPool* pool, LevelContext* c, int chunks, int out) {
+    if (!c->bottom_up) level_run(pool, c, chunks, LEVEL_CLAIM);
+    level_run(pool, c, chunks, LEVEL_COUNT);
+    int* counts = c->lt->chunk_count;
+    for (int i = 0; i < chunks; i++) {
+        int n = counts[i];
+        counts[i] = out;
+        out += n;
+    }
+    level_run(pool, c, chunks, LEVEL_WRITE);
+    return out;
+}
+
+// Пул потоков графа на threads исполнителей (пересоздаётся при другом числе)
+static ThreadPool* graph_pool(Graph* g, int threads) {
+    if (g->pool && thread_pool_size(g->pool) != threads) {
+        thread_pool_free(g->pool);
+        g->pool = NULL;
+    }
+    if (!g->pool) g->pool = thread_pool_create(threads);
+    return g->pool;
+}
+
+// Обходит по уровням вершины, достижимые из start по рёбрам PARENT: down = 1 — к детям,
+// 0 — к родителям. Результат остаётся в g->traversal (order[0] == start).
+// @return Количество найденных вершин вместе со start или -1 при ошибке памяти.
+static int level_traverse(Graph* g, const CsrView* csr, int start, int down) {
+    LevelTraversal* lt = &g->traversal;
+    int n = g->size;
+    if (level_reserve(lt, n) != 0) return -1;
+    // без пула широкие уровни раскрываются в вызывающем потоке
+    ThreadPool* pool = lt->threads > 1 ? graph_pool(g, lt->threads) : NULL;
+    LevelContext c;
+    memset(&c, 0, sizeof(c));
+    c.lt = lt;
+    c.n = n;
+    c.offs = down ? csr->offsets : csr->in_offsets;
+    c.adj = down ? csr->to : csr->in_from;
+    c.rel = down ? csr->relation : csr->in_relation;
+    c.back_offs = down ? csr->in_offsets : csr->offsets;
+    c.back_adj = down ? csr->in_from : csr->to;
+    c.back_rel = down ? csr->in_relation : csr->relation;
+
+    long unchecked = csr->edge_count; // рёбра, которые ещё может проверить раскрытие снизу вверх
+    int rank_base = 0, claimed = 0, bottom_up = 0;
+    int begin = 0, end = 1;
+    lt->order[0] = start;
+    lt->visited[start >> 6] |= (uint64_t)1 << (start & 63);
+    lt->levels = 0;
+    lt->level_start[0] = 0;
+    while (begin < end) {
+        lt->level_start[++lt->levels] = end;
+        int width = end - begin;
+        long level_edges = 0;
+        for (int i = begin; i < end; i++) level_edges += c.offs[lt->order[i] + 1] - c.offs[lt->order[i]];
+        // снизу вверх выгодно, пока рёбер уровня заметно больше, чем ещё не проверенных
+        if (lt->bottom_up) {
+            if (!bottom_up && width >= LEVEL_BOTTOM_UP_MIN && level_edges * LEVEL_ALPHA > unchecked)
+                bottom_up = 1;
+            else if (bottom_up && (long)width * LEVEL_BETA < n)
+                bottom_up = 0;
+        }
+        unchecked -= level_edges;
+        int out = end;
+        // счётчик рёбер у исполнителей пула свой, поэтому уровни кусками учитываются здесь
+        if (bottom_up) {
+            STAT_COUNT(CNT_BOTTOM_UP_LEVELS, 1);
+            for (int i = begin; i < end; i++)
+                lt->in_frontier[lt->order[i] >> 6] |= (uint64_t)1 << (lt->order[i] & 63);
+            c.bottom_up = 1;
+            c.examined = 0;
+            out = level_expand_chunks(pool, &c, (n + LEVEL_CHUNK - 1) / LEVEL_CHUNK, out);
+            STAT_EDGES(c.examined);
+            for (int i = begin; i < end; i++) lt->in_frontier[lt->order[i] >> 6] = 0;
+        } else if (pool && level_edges >= LEVEL_PARALLEL_MIN_EDGES) {
+            STAT_COUNT(CNT_PARALLEL_LEVELS, 1);
+            STAT_EDGES(level_edges);
+            for (int i = begin; i < end; i++) {
+                lt->rank[i - begin] = rank_base;
+                rank_base += c.offs[lt->order[i] + 1] - c.offs[lt->order[i]];
+            }
+            c.bottom_up = 0;
+            c.begin = begin;
+            c.end = end;
+            out = level_expand_chunks(pool, &c, (width + LEVEL_CHUNK - 1) / LEVEL_CHUNK, out);
+            claimed = 1;
+        } else {
+            for (int i = begin; i < end; i++) {
+                int u = lt->order[i];
+                STAT_EDGES(c.offs[u + 1] - c.offs[u]);
+                for (int k = c.offs[u]; k < c.offs[u + 1]; k++) {
+                    int v = c.adj[k];
+                    if (c.rel[k] != PARENT || bit_test(lt->visited, v)) continue;
+                    lt->visited[v >> 6] |= (uint64_t)1 << (v & 63);
+                    lt->order[out++] = v;
+                }
+            }
+        }
+        begin = end;
+        end = out;
+    }
+    // следующему обходу нужны чистые биты и закрепления
+    for (int i = 0; i < end; i++) {
+        int v = lt->order[i];
+        lt->visited[v >> 6] = 0;
+        if (claimed) lt->claim[v] = INT_MAX;
+    }
+    return end;
+}
+
+int graph_set_traversal(Graph* g, int threads, int bottom_up) {
+    if (!g || threads < 0) return -1;
+    g->traversal.threads = threads;
+    g->traversal.bottom_up = bottom_up != 0;
+    return 0;
+}
+
+
+// ----------- Индекс родства -------------- //
+static void kinship_free(KinshipIndex* ki) {
+    free(ki->entries);
+    free(ki->start);
+    free(ki->count);
+    memset(ki, 0, sizeof(KinshipIndex));
+}
+
+static int compare_ancestor_entries(const void* a, const void* b) {
+    const AncestorEntry* x = a;
+    const AncestorEntry* y = b;
+    if (x->ancestor != y->ancestor) return x->ancestor < y->ancestor ? -1 : 1;
+    return (x->depth > y->depth) - (x->depth < y->depth);
+}
+
+// Сортирует записи по индексу предка и оставляет для каждого минимальную глубину
+static int normalize_ancestors(AncestorEntry* list, int n) {
+    qsort(list, n, sizeof(AncestorEntry), compare_ancestor_entries);
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (m > 0 && list[m - 1].ancestor == list[i].ancestor) continue;
+        list[m++] = list[i];
+    }
+    return m;
+}
+
+// Топологический порядок вершин по рёбрам PARENT (алгоритм Кана): предки раньше потомков.
+// order должен вмещать g->size элементов.
+// @return Количество упорядоченных вершин (меньше live_count, если есть цикл), -1 при ошибке.
+static int topo_order_parent(Graph* g, const CsrView* csr, int* order) {
+    int n = g->size;
+    int* indeg = calloc(n > 0 ? n : 1, sizeof(int));
+    if (!indeg) return -1;
+    for (int k = 0; k < csr->edge_count; k++)
+        if (csr->relation[k] == PARENT) indeg[csr->to[k]]++;
+    int head = 0, tail = 0;
+    for (int i = 0; i < n; i++)
+        if (!g->vertices[i].removed && indeg[i] == 0) order[tail++] = i;
+    while (head < tail) {
+        int u = order[head++];
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+            if (csr->relation[k] == PARENT && --indeg[csr->to[k]] == 0)
+                order[tail++] = csr->to[k];
+    }
+    free(indeg);
+    return tail;
+}
+
+// Строит списки предков в топологическом порядке
+static int kinship_build(Graph* g, const CsrView* csr) {
+    KinshipIndex* ki = &g->kinship;
+    int n = g->size;
+    kinship_free(ki);
+    STAT_COUNT(CNT_KINSHIP_BUILDS, 1);
+    int* order = malloc(sizeof(int) * (n > 0 ? n : 1));
+    ki->start = calloc(n > 0 ? n : 1, sizeof(long long));
+    ki->count = calloc(n > 0 ? n : 1, sizeof(int));
+    if (!order || !ki->start || !ki->count) goto fail;
+
+    int tail = topo_order_parent(g, csr, order);
+    if (tail < 0) goto fail;
+    if (tail < g->live_count) {
+        // цикл: индекс не строим, запросы пойдут обходом графа
+        free(order);
+        kinship_free(ki);
+        ki->cyclic = 1;
+        return 0;
+    }
+
+    long long cap = n > 0 ? n : 1;
+    ki->entries = malloc(sizeof(AncestorEntry) * cap);
+    if (!ki->entries) goto fail;
+    long long used = 0;
+    for (int t = 0; t < tail; t++) {
+        int v = order[t];
+        // верхняя граница размера списка: родители и их списки целиком
+        long long need = 0;
+        for (int k = csr->in_offsets[v]; k < csr->in_offsets[v + 1]; k++)
+            if (csr->in_relation[k] == PARENT) need += 1 + ki->count[csr->in_from[k]];
+        if (used + need > cap) {
+            while (used + need > cap) cap *= 2;
+            AncestorEntry* tmp = realloc(ki->entries, sizeof(AncestorEntry) * cap);
+            if (!tmp) goto fail;
+            ki->entries = tmp;
+        }
+        AncestorEntry* list = ki->entries + used;
+        int m = 0;
+        for (int k = csr->in_offsets[v]; k < csr->in_offsets[v + 1]; k++) {
+            if (csr->in_relation[k] != PARENT) continue;
+            int p = csr->in_from[k];
+            list[m].ancestor = p;
+            list[m].depth = 1;
+            m++;
+            const AncestorEntry* pl = ki->entries + ki->start[p];
+            for (int j = 0; j < ki->count[p]; j++) {
+                list[m].ancestor = pl[j].ancestor;
+                list[m].depth = pl[j].depth + 1;
+                m++;
+            }
+        }
+        m = normalize_ancestors(list, m);
+        ki->start[v] = used;
+        ki->count[v] = m;
+        used += m;
+    }
+    free(order);
+    ki->entry_count = used;
+    ki->vertex_count = n;
+    ki->valid = 1;
+    return 0;
+
+fail:
+    free(order);
+    kinship_free(ki);
+    return -1;
+}
+
+// Возвращает актуальный индекс родства или NULL, если граф цикличен или не хватило памяти.
+// Найденный цикл запоминается до следующего изменения графа: до тех пор индекс не строится.
+static const KinshipIndex* kinship_view(Graph* g) {
+    if (g->kinship.cyclic) return NULL;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return NULL;
+    if (!g->kinship.valid && (kinship_build(g, csr) != 0 || g->kinship.cyclic)) return NULL;
+    return &g->kinship;
+}
+
+
+// ----------- Индекс достижимости -------------- //
+static void reach_free(ReachabilityIndex* ri) {
+    free(ri->bits);
+    free(ri->post);
+    free(ri->tree_low);
+    free(ri->low);
+    ri->bits = NULL;
+    ri->post = ri->tree_low = ri->low = NULL;
+    ri->words = 0;
+    ri->vertex_count = 0;
+    ri->mode = REACH_NONE;
+    ri->valid = 0;
+}
+
+// dst |= src по словам; на x86 — векторными инструкциями
+static void bitset_or(uint64_t* dst, const uint64_t* src, int words) {
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= words; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(a, b));
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= words; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(a, b));
+    }
+#endif
+    for (; i < words; i++) dst[i] |= src[i];
+}
+
+// Полное замыкание: строка вершины = объединение строк детей и самих детей
+static int reach_build_bitset(ReachabilityIndex* ri, const CsrView* csr, const int* order, int count, int n) {
+    ri->words = (n + 63) / 64;
+    ri->bits = calloc((size_t)n * ri->words > 0 ? (size_t)n * ri->words : 1, sizeof(uint64_t));
+    if (!ri->bits) return -1;
+    for (int t = count - 1; t >= 0; t--) {
+        int u = order[t];
+        uint64_t* row = ri->bits + (size_t)u * ri->words;
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            if (csr->relation[k] != PARENT) continue;
+            int c = csr->to[k];
+            row[c >> 6] |= (uint64_t)1 << (c & 63);
+            bitset_or(row, ri->bits + (size_t)c * ri->words, ri->words);
+        }
+    }
+    ri->mode = REACH_BITSET;
+    return 0;
+}
+
+// Интервальные метки: post — номер в обратном порядке DFS по остовному лесу,
+// [tree_low, post] — поддерево в лесу (гарантированная достижимость),
+// [low, post] — охватывает всех потомков (если post[v] вне диапазона, v недостижима)
+static int reach_build_interval(ReachabilityIndex* ri, const CsrView* csr,
+                                const int* order, int count, int n) {
+    ri->post = malloc(sizeof(int) * (n > 0 ? n : 1));
+    ri->tree_low = malloc(sizeof(int) * (n > 0 ? n : 1));
+    ri->low = malloc(sizeof(int) * (n > 0 ? n : 1));
+    int* stack = malloc(sizeof(int) * (n > 0 ? n : 1));
+    int* edge_pos = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (!ri->post || !ri->tree_low || !ri->low || !stack || !edge_pos) {
+        free(stack);
+        free(edge_pos);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) ri->post[i] = -1;
+    int next_post = 0;
+    // итеративный DFS; корни берём в топологическом порядке
+    for (int t = 0; t < count; t++) {
+        int root = order[t];
+        if (ri->post[root] >= 0) continue;
+        int top = 0;
+        stack[top++] = root;
+        edge_pos[root] = csr->offsets[root];
+        ri->post[root] = -2; // «в обработке»
+        ri->tree_low[root] = next_post;
+        while (top > 0) {
+            int u = stack[top - 1];
+            if (edge_pos[u] < csr->offsets[u + 1]) {
+                int k = edge_pos[u]++;
+                int c = csr->to[k];
+                if (csr->relation[k] != PARENT || ri->post[c] != -1) continue;
+                ri->post[c] = -2;
+                ri->tree_low[c] = next_post;
+                edge_pos[c] = csr->offsets[c];
+                stack[top++] = c;
+            } else {
+                ri->post[u] = next_post++;
+                top--;
+            }
+        }
+    }
+    // low считаем в обратном топологическом порядке
+    for (int t = count - 1; t >= 0; t--) {
+        int u = order[t];
+        int low = ri->tree_low[u];
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+            if (csr->relation[k] == PARENT && ri->low[csr->to[k]] < low)
+                low = ri->low[csr->to[k]];
+        ri->low[u] = low;
+    }
+    free(stack);
+    free(edge_pos);
+    ri->mode = REACH_INTERVAL;
+    return 0;
+}
+
+static int reach_build(Graph* g) {
+    ReachabilityIndex* ri = &g->reach;
+    if (ri->cyclic) return -1; // цикл уже найден, граф с тех пор не менялся
+    reach_free(ri);
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    STAT_COUNT(CNT_REACH_BUILDS, 1);
+    int n = g->size;
+    int* order = malloc(sizeof(int) * (n > 0 ? n : 1));
+    if (!order) return -1;
+    int count = topo_order_parent(g, csr, order);
+    if (count < 0 || count < g->live_count) {
+        free(order); // цикл — индекс не строится
+        if (count >= 0) ri->cyclic = 1;
+        return -1;
+    }
+    size_t bytes = (size_t)n * (size_t)((n + 63) / 64) * sizeof(uint64_t);
+    int rc = bytes <= REACH_BITSET_MAX_BYTES
+        ? reach_build_bitset(ri, csr, order, count, n)
+        : reach_build_interval(ri, csr, order, count, n);
+    free(order);
+    if (rc != 0) {
+        reach_free(ri);
+        return -1;
+    }
+    ri->vertex_count = n;
+    ri->valid = 1;
+    return 0;
+}
+
+int graph_build_reachability(Graph* g) {
+    if (!g) return -1;
+    g->reach.enabled = 1;
+    return reach_build(g);
+}
+
+// ----------- Индекс отрезков жизни -------------- //
+// Растущий список индексов вершин для результатов запросов
+typedef struct {
+    int* ids;
+    int count;
+    int capacity;
+} IdList;
+
+static int id_list_push(IdList* l, int v) {
+    if (l->count == l->capacity) {
+        int cap = l->capacity ? l->capacity * 2 : 64;
+        int* tmp = realloc(l->ids, sizeof(int) * cap);
+        if (!tmp) return -1;
+        l->ids = tmp;
+        l->capacity = cap;
+    }
+    l->ids[l->count++] = v;
+    return 0;
+}
+
+// --- Изменения после построения индекса --- //
+static void delta_free(IndexDelta* d) {
+    free(d->where);
+    free(d->items);
+    memset(d, 0, sizeof(*d));
+}
+
+static int delta_reserve(IndexDelta* d, int n) {
+    if (n <= d->where_capacity) return 0;
+    int* tmp = realloc(d->where, sizeof(int) * n);
+    if (!tmp) return -1;
+    for (int i = d->where_capacity; i < n; i++) tmp[i] = DELTA_NONE;
+    d->where = tmp;
+    d->where_capacity = n;
+    return 0;
+}
+
+// Ставит человека в список ещё не попавших в индекс
+static int delta_push(IndexDelta* d, int v) {
+    if (d->count == d->capacity) {
+        int cap = d->capacity ? d->capacity * 2 : 64;
+        int* tmp = realloc(d->items, sizeof(int) * cap);
+        if (!tmp) return -1;
+        d->items = tmp;
+        d->capacity = cap;
+    }
+    d->where[v] = d->count;
+    d->items[d->count++] = v;
+    return 0;
+}
+
+// Исключает человека из индекса: запись в построенном индексе становится
+// недействительной, из items он удаляется перестановкой последнего на его место
+static void delta_unlink(IndexDelta* d, int v) {
+    int pos = d->where[v];
+    if (pos == DELTA_BUILT) {
+        d->stale++;
+    } else if (pos >= 0) {
+        int last = d->items[--d->count];
+        d->items[pos] = last;
+        d->where[last] = pos;
+    }
+    d->where[v] = DELTA_NONE;
+}
+
+// Человек добавлен или его данные изменились: он проверяется отдельно до перестроения
+static int delta_changed(IndexDelta* d, int v) {
+    if (d->where[v] >= 0) return 0; // items читаются из графа при каждом запросе
+    delta_unlink(d, v);
+    return delta_push(d, v);
+}
+
+// Пора ли перестроить индекс из built записей
+static int delta_dirty(const IndexDelta* d, int built) {
+    int dirty = d->count + d->stale;
+    return dirty > DELTA_MIN_DIRTY && dirty > built / DELTA_DIRTY_SHARE;
+}
+
+// Помечает всех живых людей как попавших в индекс
+static void delta_reset(IndexDelta* d, const Graph* g) {
+    for (int v = 0; v < g->size; v++) d->where[v] = g->vertices[v].removed ? DELTA_NONE : DELTA_BUILT;
+    d->count = 0;
+    d->stale = 0;
+}
+
+
+// --- Дерево отрезков жизни --- //
+static void lifespan_free(LifespanIndex* li) {
+    free(li->nodes);
+    free(li->by_birth);
+    free(li->by_death);
+    delta_free(&li->delta);
+    memset(li, 0, sizeof(*li));
+}
+
+// Человек добавлен или его годы изменились
+static void lifespan_changed(Graph* g, int v) {
+    // без памяти индекс выключается и при следующем запросе строится заново
+    if (delta_changed(&g->lifespan.delta, v) != 0) lifespan_free(&g->lifespan);
+}
+
+static int compare_entry_birth(const void* a, const void* b) {
+    const LifespanEntry* x = a;
+    const LifespanEntry* y = b;
+    if (x->birth != y->birth) return x->birth < y->birth ? -1 : 1;
+    return (x->person > y->person) - (x->person < y->person);
+}
+
+static int compare_entry_death_desc(const void* a, const void* b) {
+    const LifespanEntry* x = a;
+    const LifespanEntry* y = b;
+    return (x->death < y->death) - (x->death > y->death);
+}
+
+// Строит поддерево из отрезков items[0..n), упорядоченных по году рождения;
+// tmp — буфер на n записей. Центр — медианный год рождения, поэтому в каждое
+// поддерево уходит не больше половины отрезков.
+// @return Номер узла или -1, если отрезков нет.
+static int lifespan_build_node(LifespanIndex* li, LifespanEntry* items, LifespanEntry* tmp,
+                               int n, int* pos) {
+    if (n == 0) return -1;
+    int center = items[n / 2].birth;
+    // правее центра — суффикс (рождение позже center)
+    int right = n;
+    while (right > 0 && items[right - 1].birth > center) right--;
+    // левее центра — умершие до center; остальные отрезки содержат center
+    int left = 0, mid = 0;
+    for (int i = 0; i < right; i++) {
+        if (items[i].death < center) items[left++] = items[i];
+        else tmp[mid++] = items[i];
+    }
+    int node = li->node_count++;
+    li->nodes[node].center = center;
+    li->nodes[node].first = *pos;
+    li->nodes[node].count = mid;
+    memcpy(li->by_birth + *pos, tmp, sizeof(LifespanEntry) * mid);
+    memcpy(li->by_death + *pos, tmp, sizeof(LifespanEntry) * mid);
+    qsort(li->by_death + *pos, mid, sizeof(LifespanEntry), compare_entry_death_desc);
+    *pos += mid;
+    int l = lifespan_build_node(li, items, tmp, left, pos);
+    int r = lifespan_build_node(li, items + right, tmp, n - right, pos);
+    li->nodes[node].left = l;
+    li->nodes[node].right = r;
+    return node;
+}
+
+// Строит дерево заново по всем людям графа; накопленные изменения сбрасываются
+static int lifespan_build(Graph* g) {
+    STAT_COUNT(CNT_LIFESPAN_BUILDS, 1);
+    LifespanIndex* li = &g->lifespan;
+    if (delta_reserve(&li->delta, g->capacity) != 0) return -1;
+    int n = g->live_count > 0 ? g->live_count : 1;
+    LifespanEntry* items = malloc(sizeof(LifespanEntry) * n);
+    LifespanEntry* tmp = malloc(sizeof(LifespanEntry) * n);
+    LifespanNode* nodes = malloc(sizeof(LifespanNode) * n);
+    LifespanEntry* by_birth = malloc(sizeof(LifespanEntry) * n);
+    LifespanEntry* by_death = malloc(sizeof(LifespanEntry) * n);
+    if (!items || !tmp || !nodes || !by_birth || !by_death) {
+        free(items); free(tmp); free(nodes); free(by_birth); free(by_death);
+        return -1;
+    }
+    int count = 0;
+    for (int v = 0; v < g->size; v++) {
+        if (g->vertices[v].removed) continue;
+        int birth = g->people.birth_year[v];
+        int death = g->people.death_year[v] < 0 ? INT_MAX : g->people.death_year[v];
+        // год смерти раньше рождения — пустой отрезок, такой человек не находится
+        if (death < birth) continue;
+        items[count].person = v;
+        items[count].birth = birth;
+        items[count].death = death;
+        count++;
+    }
+    qsort(items, count, sizeof(LifespanEntry), compare_entry_birth);
+    free(li->nodes);
+    free(li->by_birth);
+    free(li->by_death);
+    li->nodes = nodes;
+    li->by_birth = by_birth;
+    li->by_death = by_death;
+    li->node_count = 0;
+    int pos = 0;
+    lifespan_build_node(li, items, tmp, count, &pos);
+    li->tree_count = count;
+    delta_reset(&li->delta, g);
+    free(items);
+    free(tmp);
+    return 0;
+}
+
+// Включает индекс при первом запросе и перестраивает его, если изменений накопилось много
+static const LifespanIndex* lifespan_view(Graph* g) {
+    LifespanIndex* li = &g->lifespan;
+    if (!li->enabled || delta_dirty(&li->delta, li->tree_count)) {
+        if (lifespan_build(g) != 0) {
+            lifespan_free(li);
+            return NULL;
+        }
+        li->enabled = 1;
+    }
+    return li;
+}
+
+// Собирает отрезки поддерева node, пересекающие [from, to]
+static int lifespan_collect(const LifespanIndex* li, int node, int from, int to, IdList* out) {
+    while (node >= 0) {
+        const LifespanNode* nd = &li->nodes[node];
+        const LifespanEntry* e;
+        int end = nd->first + nd->count;
+        if (to < nd->center) {
+            // все отрезки узла заканчиваются не раньше center > to: важно только начало
+            for (e = li->by_birth + nd->first; e < li->by_birth + end && e->birth <= to; e++)
+                if (li->delta.where[e->person] == DELTA_BUILT && id_list_push(out, e->person) != 0) return -1;
+            node = nd->left;
+        } else if (from > nd->center) {
+            // все отрезки узла начинаются не позже center < from: важен только конец
+            for (e = li->by_death + nd->first; e < li->by_death + end && e->death >= from; e++)
+                if (li->delta.where[e->person] == DELTA_BUILT && id_list_push(out, e->person) != 0) return -1;
+            node = nd->right;
+        } else {
+            for (e = li->by_birth + nd->first; e < li->by_birth + end; e++)
+                if (li->delta.where[e->person] == DELTA_BUILT && id_list_push(out, e->person) != 0) return -1;
+            if (lifespan_collect(li, nd->left, from, to, out) != 0) return -1;
+            node = nd->right;
+        }
+    }
+    return 0;
+}
+
+int lifespan_overlapping(Graph* g, int from, int to, int** out) {
+    STAT_SCOPE(OP_LIFESPAN_QUERY);
+    if (!g || !out) return -1;
+    *out = NULL;
+    const LifespanIndex* li = lifespan_view(g);
+    if (!li) return -1;
+    IdList found = { NULL, 0, 0 };
+    int ok = from > to || lifespan_collect(li, li->node_count > 0 ? 0 : -1, from, to, &found) == 0;
+    // люди, изменённые после построения дерева, проверяются по столбцам
+    for (int i = 0; ok && from <= to && i < li->delta.count; i++) {
+        int v = li->delta.items[i];
+        int birth = g->people.birth_year[v];
+        int death = g->people.death_year[v] < 0 ? INT_MAX : g->people.death_year[v];
+        if (birth <= death && birth <= to && death >= from) ok = id_list_push(&found, v) == 0;
+    }
+    // пустой результат — тоже массив, который вызывающий освобождает
+    if (ok && !found.ids) ok = (found.ids = malloc(sizeof(int))) != NULL;
+    if (!ok) {
+        free(found.ids);
+        return -1;
+    }
+    *out = found.ids;
+    return found.count;
+}
+
+int lifespan_alive_in(Graph* g, int year, int** out) {
+    return lifespan_overlapping(g, year, year, out);
+}
+
+
+// ----------- Индекс имён -------------- //
+// Свёртка регистра: латиница и кириллица — в строчные, ё — в е
+static int fold_codepoint(int cp) {
+    if (cp >= 'A' && cp <= 'Z') return cp + ('a' - 'A');
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;   // А..Я
+    if (cp == 0x401 || cp == 0x451) return 0x435;       // Ё, ё
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;   // Ѐ..Џ
+    return cp;
+}
+
+// Читает очередной символ UTF-8 и возвращает его после свёртки регистра (0 — конец строки).
+// Байт, не начинающий правильную последовательность, считается отдельным символом.
+static int fold_next(const char** p) {
+    const unsigned char* s = (const unsigned char*)*p;
+    int c = s[0];
+    if (c == 0) return 0;
+    int cp = c, len = 1;
+    if (c >= 0xC2 && c <= 0xDF && (s[1] & 0xC0) == 0x80) {
+        cp = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+        cp = ((c & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        len = 3;
+    } else if (c >= 0xF0 && c <= 0xF4 && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80
+               && (s[3] & 0xC0) == 0x80) {
+        cp = ((c & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+        len = 4;
+    } else if (c >= 0x80) {
+        cp = 0x110000 + c; // за пределами Юникода: не совпадает ни с одним символом
+    }
+    *p += len;
+    return fold_codepoint(cp);
+}
+
+// Свёртка строки в массив символов (не больше max); @return количество символов
+static int fold_string(const char* s, int* out, int max) {
+    int n = 0, c;
+    while (n < max && (c = fold_next(&s)) != 0) out[n++] = c;
+    return n;
+}
+
+// Записывает свёрнутый символ в UTF-8 (out == NULL — только длина). Символы за пределами
+// Юникода тоже занимают 4 байта, поэтому memcmp упорядочивает свёрнутые строки так же,
+// как последовательности их символов. @return Количество байтов.
+static int fold_put(int cp, char* out) {
+    int len = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+    if (!out) return len;
+    unsigned char* s = (unsigned char*)out;
+    switch (len) {
+        case 1: s[0] = (unsigned char)cp; break;
+        case 2: s[0] = 0xC0 | (cp >> 6); s[1] = 0x80 | (cp & 0x3F); break;
+        case 3: s[0] = 0xE0 | (cp >> 12); s[1] = 0x80 | ((cp >> 6) & 0x3F); s[2] = 0x80 | (cp & 0x3F); break;
+        default:
+            s[0] = 0xF0 | (cp >> 18); s[1] = 0x80 | ((cp >> 12) & 0x3F);
+            s[2] = 0x80 | ((cp >> 6) & 0x3F); s[3] = 0x80 | (cp & 0x3F);
+    }
+    return len;
+}
+
+// Свёртка символов chars[0..n) в байты; @return длина в байтах
+static int fold_encode(const int* chars, int n, char* out) {
+    int len = 0;
+    for (int i = 0; i < n; i++) len += fold_put(chars[i], out ? out + len : NULL);
+    return len;
+}
+
+// Восемь байтов ключа с некоторой глубины как число (порядок чисел совпадает с memcmp)
+typedef struct {
+    uint64_t word;
+    int index;
+} NameSortItem;
+
+static int compare_sort_items(const void* a, const void* b) {
+    uint64_t x = ((const NameSortItem*)a)->word;
+    uint64_t y = ((const NameSortItem*)b)->word;
+    return (x > y) - (x < y);
+}
+
+// Поразрядная сортировка items[0..n) по word, по байту за проход начиная с младшего;
+// проход пропускается, если байт у всех одинаковый (у имён длинные общие начала)
+static void sort_items_radix(NameSortItem* items, NameSortItem* buf, int n) {
+    NameSortItem* src = items;
+    NameSortItem* dst = buf;
+    for (int shift = 0; shift < 64; shift += 8) {
+        int start[257] = { 0 };
+        for (int i = 0; i < n; i++) start[((src[i].word >> shift) & 0xFF) + 1]++;
+        if (start[((src[0].word >> shift) & 0xFF) + 1] == n) continue;
+        for (int b = 0; b < 256; b++) start[b + 1] += start[b];
+        for (int i = 0; i < n; i++) dst[start[(src[i].word >> shift) & 0xFF]++] = src[i];
+        NameSortItem* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != items) memcpy(items, src, sizeof(NameSortItem) * n);
+}
+
+// Упорядочивает e[0..n) по байтам ключей начиная с depth, по восемь байтов за шаг:
+// ключ читается один раз на шаг, а не в каждом сравнении. items, buf и tmp — не меньше n.
+static void name_entries_sort(NameEntry* e, int n, int depth, NameSortItem* items, NameSortItem* buf,
+                              NameEntry* tmp) {
+    if (n < 2) return;
+    for (int i = 0; i < n; i++) {
+        // после конца ключа — нули: в ключах нулевых байтов нет, и короткий ключ раньше
+        uint64_t w = 0;
+        for (int b = depth; b < depth + 8; b++)
+            w = w << 8 | (b < e[i].len ? (unsigned char)e[i].key[b] : 0);
+        items[i].word = w;
+        items[i].index = i;
+    }
+    if (n < NAME_RADIX_MIN) qsort(items, n, sizeof(NameSortItem), compare_sort_items);
+    else sort_items_radix(items, buf, n);
+    for (int i = 0; i < n; i++) tmp[i] = e[items[i].index];
+    memcpy(e, tmp, sizeof(NameEntry) * n);
+    // если при одинаковых восьми байтах один ключ кончился раньше, то и остальные
+    // (совпадают целиком); иначе порядок решают следующие байты
+    for (int i = 0; i < n;) {
+        int j = i + 1;
+        while (j < n && items[j].word == items[i].word) j++;
+        if (e[i].len >= depth + 8)
+            name_entries_sort(e + i, j - i, depth + 8, items + i, buf + i, tmp + i);
+        i = j;
+    }
+}
+
+// Сравнивает начало ключа с prefix[0..len): 0 — ключ начинается с prefix
+static int key_compare_prefix(const NameEntry* e, const char* prefix, int len) {
+    int c = memcmp(e->key, prefix, e->len < len ? e->len : len);
+    return c ? c : e->len < len ? -1 : 0;
+}
+
+// Начинается ли несвёрнутое имя с символов prefix[0..len) (для людей вне индекса)
+static int name_has_prefix(const char* name, const int* prefix, int len) {
+    for (int i = 0; i < len; i++)
+        if (fold_next(&name) != prefix[i]) return 0;
+    return 1;
+}
+
+// Первая запись в [lo, hi), ключ которой не меньше (upper == 0) или больше (upper == 1)
+// диапазона ключей с началом prefix[0..len) (свёрнутые байты)
+static int name_bound(const NameEntry* e, int lo, int hi, const char* prefix, int len, int upper) {
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = key_compare_prefix(&e[mid], prefix, len);
+        if (c < 0 || (upper && c == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void name_search_free(NameSearchIndex* ni) {
+    free(ni->folded);
+    free(ni->names);
+    free(ni->words);
+    delta_free(&ni->delta);
+    memset(ni, 0, sizeof(*ni));
+}
+
+// Человек добавлен: до перестроения индекса он проверяется отдельно
+static void name_search_added(Graph* g, int v) {
+    if (delta_changed(&g->name_search.delta, v) != 0) name_search_free(&g->name_search);
+}
+
+// Строит индекс заново: имена целиком и каждое слово после первого. Имена сворачиваются
+// один раз, и при сортировке и поиске ключи сравниваются как байты без разбора UTF-8.
+static int name_search_build(Graph* g) {
+    STAT_COUNT(CNT_NAME_INDEX_BUILDS, 1);
+    NameSearchIndex* ni = &g->name_search;
+    if (delta_reserve(&ni->delta, g->capacity) != 0) return -1;
+    size_t bytes = 0;
+    int words = 0;
+    for (int v = 0; v < g->size; v++) {
+        if (g->vertices[v].removed) continue;
+        const char* p = g->vertices[v].name;
+        size_t len = strlen(p);
+        // свёртка корректного UTF-8 не меняет длину символов
+        if (utf8_find_invalid(p, len, NULL) == len) bytes += len;
+        else for (int c; (c = fold_next(&p)) != 0;) bytes += fold_put(c, NULL);
+        bytes++;
+        for (p = g->vertices[v].name; *p; p++)
+            if (*p == ' ' && p[1] && p[1] != ' ') words++;
+    }
+    int most = g->live_count > words ? g->live_count : words;
+    char* folded = malloc(bytes > 0 ? bytes : 1);
+    NameEntry* names = malloc(sizeof(NameEntry) * (g->live_count > 0 ? g->live_count : 1));
+    NameEntry* word_entries = malloc(sizeof(NameEntry) * (words > 0 ? words : 1));
+    NameSortItem* items = malloc(sizeof(NameSortItem) * 2 * (most > 0 ? most : 1));
+    NameEntry* tmp = malloc(sizeof(NameEntry) * (most > 0 ? most : 1));
+    if (!folded || !names || !word_entries || !items || !tmp) {
+        free(folded);
+        free(names);
+        free(word_entries);
+        free(items);
+        free(tmp);
+        return -1;
+    }
+    int n = 0, w = 0;
+    char* out = folded;
+    for (int v = 0; v < g->size; v++) {
+        if (g->vertices[v].removed) continue;
+        // пробел сворачивается сам в себя, так что слова — хвосты свёрнутого имени
+        char* key = out;
+        int first = w;
+        const char* p = g->vertices[v].name;
+        for (int c, prev = 0; (c = fold_next(&p)) != 0; prev = c) {
+            if (prev == ' ' && c != ' ') {
+                word_entries[w].key = out;
+                word_entries[w++].person = v;
+            }
+            out += fold_put(c, out);
+        }
+        *out = '\0';
+        names[n].key = key;
+        names[n].len = (int)(out - key);
+        names[n++].person = v;
+        for (int i = first; i < w; i++) word_entries[i].len = (int)(out - word_entries[i].key);
+        out++;
+    }
+    name_entries_sort(names, n, 0, items, items + most, tmp);
+    name_entries_sort(word_entries, w, 0, items, items + most, tmp);
+    free(items);
+    free(tmp);
+    free(ni->folded);
+    free(ni->names);
+    free(ni->words);
+    ni->folded = folded;
+    ni->names = names;
+    ni->name_count = n;
+    ni->words = word_entries;
+    ni->word_count = w;
+    delta_reset(&ni->delta, g);
+    return 0;
+}
+
+static const NameSearchIndex* name_search_view(Graph* g) {
+    NameSearchIndex* ni = &g->name_search;
+    if (!ni->enabled || delta_dirty(&ni->delta, ni->name_count)) {
+        if (name_search_build(g) != 0) {
+            name_search_free(ni);
+            return NULL;
+        }
+        ni->enabled = 1;
+    }
+    return ni;
+}
+
+// Добавляет человека в результат, если он ещё не добавлен и запись индекса действительна
+static int name_report(const NameSearchIndex* ni, SearchScratch* sc, IdList* out, int v, int built) {
+    if (built && ni->delta.where[v] != DELTA_BUILT) return 0;
+    if (sc->mark_fwd[v] == sc->stamp) return 0;
+    sc->mark_fwd[v] = sc->stamp;
+    return id_list_push(out, v);
+}
+
+// Возвращает список результатов (пустой — тоже массив, который освобождает вызывающий)
+static int name_result(IdList* found, int ok, int** out) {
+    if (ok && !found->ids) ok = (found->ids = malloc(sizeof(int))) != NULL;
+    if (!ok) {
+        free(found->ids);
+        return -1;
+    }
+    *out = found->ids;
+    return found->count;
+}
+
+// Поиск по началу имени (surname == 0) или одного из слов после первого (surname == 1)
+static int name_search_prefix(Graph* g, const char* text, int surname, int** out) {
+    STAT_SCOPE(OP_SEARCH_NAMES);
+    if (!g || !text || !out) return -1;
+    *out = NULL;
+    int prefix[NAME_SEARCH_MAX_LEN];
+    int len = fold_string(text, prefix, NAME_SEARCH_MAX_LEN);
+    char key[NAME_SEARCH_MAX_LEN * 4];
+    int key_len = fold_encode(prefix, len, key);
+    const NameSearchIndex* ni = name_search_view(g);
+    if (!ni || scratch_begin(&g->scratch, g->size) != 0) return -1;
+    SearchScratch* sc = &g->scratch;
+    const NameEntry* e = surname ? ni->words : ni->names;
+    int n = surname ? ni->word_count : ni->name_count;
+    IdList found = { NULL, 0, 0 };
+    int ok = 1;
+    int hi = name_bound(e, 0, n, key, key_len, 1);
+    for (int i = name_bound(e, 0, hi, key, key_len, 0); ok && i < hi; i++)
+        ok = name_report(ni, sc, &found, e[i].person, 1) == 0;
+    // добавленные после построения — проверяются по имени
+    for (int i = 0; ok && i < ni->delta.count; i++) {
+        int v = ni->delta.items[i];
+        const char* name = g->vertices[v].name;
+        int match = !surname && name_has_prefix(name, prefix, len);
+        for (const char* p = name; surname && !match && *p; p++)
+            match = *p == ' ' && p[1] && p[1] != ' ' && name_has_prefix(p + 1, prefix, len);
+        if (match) ok = name_report(ni, sc, &found, v, 0) == 0;
+    }
+    return name_result(&found, ok, out);
+}
+
+int search_names_prefix(Graph* g, const char* prefix, int** out) {
+    return name_search_prefix(g, prefix, 0, out);
+}
+
+int search_names_by_surname(Graph* g, const char* prefix, int** out) {
+    return name_search_prefix(g, prefix, 1, out);
+}
+
+// Строка d таблицы расстояний Левенштейна по строке r - (m + 1) (символ ключа c).
+// @return Минимум строки: если он больше допуска, продолжение ключа не поможет.
+static int fuzzy_row(int* r, int d, int c, const int* q, int m) {
+    const int* prev = r - (m + 1);
+    r[0] = d;
+    int best = d;
+    for (int j = 1; j <= m; j++) {
+        int v = prev[j - 1] + (c != q[j - 1]);
+        if (prev[j] + 1 < v) v = prev[j] + 1;
+        if (r[j - 1] + 1 < v) v = r[j - 1] + 1;
+        r[j] = v;
+        if (v < best) best = v;
+    }
+    return best;
+}
+
+// Обходит записи индекса по алфавиту как неявное префиксное дерево: строки таблицы
+// расстояний для общего с предыдущим ключом начала не пересчитываются, а все ключи
+// с началом, на котором минимум строки превысил k, пропускаются двоичным поиском.
+// Совпадением считается первое слово ключа, а при whole == 1 — и ключ целиком.
+static int fuzzy_scan(const NameSearchIndex* ni, const NameEntry* e, int n, const int* q, int m,
+                      int k, int whole, int* rows, SearchScratch* sc, IdList* out) {
+    int cur[NAME_SEARCH_MAX_LEN], prev[NAME_SEARCH_MAX_LEN];
+    int prev_len = 0, computed = 0;
+    for (int j = 0; j <= m; j++) rows[j] = j;
+    int i = 0;
+    while (i < n) {
+        int len = fold_string(e[i].key, cur, NAME_SEARCH_MAX_LEN);
+        int d = 0;
+        while (d < len && d < prev_len && d < computed && cur[d] == prev[d]) d++;
+        int pruned = 0;
+        for (d++; d <= len; d++) {
+            if (fuzzy_row(rows + d * (m + 1), d, cur[d - 1], q, m) > k) {
+                pruned = 1;
+                break;
+            }
+        }
+        computed = pruned ? d : len;
+        memcpy(prev, cur, sizeof(int) * len);
+        prev_len = len;
+        int space = 0;
+        while (space < len && cur[space] != ' ') space++;
+        int word = space <= computed && rows[space * (m + 1) + m] <= k;
+        int full = whole && !pruned && rows[len * (m + 1) + m] <= k;
+        if ((word || full) && name_report(ni, sc, out, e[i].person, 1) != 0) return -1;
+        if (!pruned) {
+            i++;
+            continue;
+        }
+        // у следующих ключей с тем же началом cur[0..d) те же строки таблицы: полного
+        // совпадения у них нет, а совпадение первого слова — такое же, как у текущего
+        const char* p = e[i].key;
+        for (int t = 0; t < d; t++) fold_next(&p);
+        int end = name_bound(e, i + 1, n, e[i].key, (int)(p - e[i].key), 1);
+        for (int t = i + 1; word && t < end; t++)
+            if (name_report(ni, sc, out, e[t].person, 1) != 0) return -1;
+        i = end;
+    }
+    return 0;
+}
+
+// Проверяет одно имя без индекса: имя целиком и каждое его слово
+static int fuzzy_match_name(const char* name, const int* q, int m, int k, int* rows) {
+    int cur[NAME_SEARCH_MAX_LEN];
+    for (const char* p = name; *p; p++) {
+        if (*p == ' ' || (p != name && p[-1] != ' ')) continue;
+        int len = fold_string(p, cur, NAME_SEARCH_MAX_LEN);
+        int space = 0;
+        while (space < len && cur[space] != ' ') space++;
+        int last = p == name ? len : space;
+        for (int j = 0; j <= m; j++) rows[j] = j;
+        int d = 1;
+        for (; d <= last; d++)
+            if (fuzzy_row(rows + d * (m + 1), d, cur[d - 1], q, m) > k) break;
+        // строки до d - 1 включительно посчитаны
+        if (space < d && rows[space * (m + 1) + m] <= k) return 1;
+        if (p == name && d > len && rows[len * (m + 1) + m] <= k) return 1;
+    }
+    return 0;
+}
+
+int search_names_fuzzy(Graph* g, const char* query, int max_distance, int** out) {
+    STAT_SCOPE(OP_SEARCH_NAMES);
+    if (!g || !query || !out || max_distance < 0 || max_distance > NAME_FUZZY_MAX_DISTANCE) return -1;
+    *out = NULL;
+    int q[NAME_SEARCH_MAX_LEN];
+    int m = fold_string(query, q, NAME_SEARCH_MAX_LEN);
+    const NameSearchIndex* ni = name_search_view(g);
+    if (!ni || scratch_begin(&g->scratch, g->size) != 0) return -1;
+    int* rows = malloc(sizeof(int) * (NAME_SEARCH_MAX_LEN + 1) * (m + 1));
+    if (!rows) return -1;
+    SearchScratch* sc = &g->scratch;
+    IdList found = { NULL, 0, 0 };
+    int ok = fuzzy_scan(ni, ni->names, ni->name_count, q, m, max_distance, 1, rows, sc, &found) == 0
+        && fuzzy_scan(ni, ni->words, ni->word_count, q, m, max_distance, 0, rows, sc, &found) == 0;
+    for (int i = 0; ok && i < ni->delta.count; i++) {
+        int v = ni->delta.items[i];
+        if (fuzzy_match_name(g->vertices[v].name, q, m, max_distance, rows))
+            ok = name_report(ni, sc, &found, v, 0) == 0;
+    }
+    free(rows);
+    return name_result(&found, ok, out);
+}
+
+
+// ----------- Сводки по потомкам -------------- //
+static void aggregates_free(DescendantAggregates* da) {
+    free(da->items);
+    free(da->fresh);
+    memset(da, 0, sizeof(DescendantAggregates));
+}
+
+static int aggregates_reserve(DescendantAggregates* da, int n) {
+    if (n <= da->capacity) return 0;
+    int cap = da->capacity ? da->capacity : INITIAL_CAPACITY;
+    while (cap < n) cap *= 2;
+    DescendantSummary* items = realloc(da->items, sizeof(DescendantSummary) * cap);
+    if (!items) return -1;
+    da->items = items;
+    unsigned char* fresh = realloc(da->fresh, cap);
+    if (!fresh) return -1;
+    memset(fresh + da->capacity, 0, cap - da->capacity);
+    da->fresh = fresh;
+    da->capacity = cap;
+    return 0;
+}
+
+// Вес живого потомка в d поколениях
+static double heir_weight(int d) {
+    return ldexp(1.0, 1 - d);
+}
+
+static int is_alive(const Graph* g, int v) {
+    return g->people.death_year[v] < 0;
+}
+
+static int has_children(const Graph* g, int v) {
+    for (Edge* e = g->vertices[v].edges; e; e = e->next)
+        if (e->relation == PARENT) return 1;
+    return 0;
+}
+
+// Сводка по потомкам v обходом в ширину по спискам рёбер (снимок после изменений
+// устарел, а перестраивать его ради одной вершины дороже обхода)
+static int summary_compute(Graph* g, int v, DescendantSummary* out) {
+    SearchScratch* sc = &g->scratch;
+    if (scratch_begin(sc, g->size) != 0) return -1;
+    int head = 0, tail = 0;
+    sc->mark_fwd[v] = sc->stamp;
+    sc->dist_fwd[v] = 0;
+    sc->queue_fwd[tail++] = v;
+    out->descendants = 0;
+    out->living = 0;
+    out->weight = 0.0;
+    while (head < tail) {
+        int u = sc->queue_fwd[head++];
+        for (Edge* e = g->vertices[u].edges; e; e = e->next) {
+            STAT_EDGES(1);
+            int c = e->to;
+            if (e->relation != PARENT || sc->mark_fwd[c] == sc->stamp) continue;
+            sc->mark_fwd[c] = sc->stamp;
+            sc->dist_fwd[c] = sc->dist_fwd[u] + 1;
+            sc->queue_fwd[tail++] = c;
+            out->descendants++;
+            if (is_alive(g, c)) {
+                out->living++;
+                out->weight += heir_weight(sc->dist_fwd[c]);
+            }
+        }
+    }
+    return 0;
+}
+
+// Обратный обход от x по входящим рёбрам PARENT: все предки с расстоянием до x.
+// Сам x лежит в queue[0] с расстоянием 0. Возвращает длину очереди.
+static int ancestors_of(const Graph* g, int x, unsigned int stamp,
+                        unsigned int* mark, int* dist, int* queue) {
+    int head = 0, tail = 0;
+    mark[x] = stamp;
+    dist[x] = 0;
+    queue[tail++] = x;
+    while (head < tail) {
+        int u = queue[head++];
+        for (Edge* e = g->vertices[u].in_edges; e; e = e->next_in) {
+            STAT_EDGES(1);
+            int p = e->from;
+            if (e->relation != PARENT || mark[p] == stamp) continue;
+            mark[p] = stamp;
+            dist[p] = dist[u] + 1;
+            queue[tail++] = p;
+        }
+    }
+    return tail;
+}
+
+// Помечает устаревшими сводки x и всех его предков
+static void aggregates_mark_stale(Graph* g, int x) {
+    SearchScratch* sc = &g->scratch;
+    if (scratch_begin(sc, g->size) != 0) {
+        // без буферов точечно не пометить — сбрасываем все сводки
+        memset(g->aggregates.fresh, 0, g->aggregates.capacity);
+        return;
+    }
+    int n = ancestors_of(g, x, sc->stamp, sc->mark_fwd, sc->dist_fwd, sc->queue_fwd);
+    for (int i = 0; i < n; i++) g->aggregates.fresh[sc->queue_fwd[i]] = 0;
+}
+
+// Начало изменения связей листа c (у него нет детей): запоминает предков c
+// до изменения в прямых буферах. Возвращает их число (вместе с c) или -1,
+// если буферов нет и нужен запасной путь.
+static int aggregates_leaf_begin(Graph* g, int c) {
+    SearchScratch* sc = &g->scratch;
+    if (scratch_begin(sc, g->size) != 0) return -1;
+    return ancestors_of(g, c, sc->stamp, sc->mark_fwd, sc->dist_fwd, sc->queue_fwd);
+}
+
+// Завершение изменения связей листа c: сравнивает предков до и после и
+// применяет к актуальным сводкам точные приращения
+static void aggregates_leaf_end(Graph* g, int c, int before) {
+    SearchScratch* sc = &g->scratch;
+    DescendantAggregates* da = &g->aggregates;
+    unsigned int stamp = sc->stamp;
+    int after = ancestors_of(g, c, stamp, sc->mark_bwd, sc->dist_bwd, sc->queue_bwd);
+    int alive = is_alive(g, c);
+    // новые предки и предки, у которых изменилось расстояние
+    for (int i = 1; i < after; i++) {
+        int a = sc->queue_bwd[i];
+        if (!da->fresh[a]) continue;
+        DescendantSummary* s = &da->items[a];
+        int was = sc->mark_fwd[a] == stamp;
+        if (!was) {
+            s->descendants++;
+            s->living += alive;
+        }
+        if (alive)
+            s->weight += heir_weight(sc->dist_bwd[a]) - (was ? heir_weight(sc->dist_fwd[a]) : 0.0);
+    }
+    // бывшие предки, для которых c больше не потомок
+    for (int i = 1; i < before; i++) {
+        int a = sc->queue_fwd[i];
+        if (sc->mark_bwd[a] == stamp || !da->fresh[a]) continue;
+        DescendantSummary* s = &da->items[a];
+        s->descendants--;
+        s->living -= alive;
+        if (alive) s->weight -= heir_weight(sc->dist_fwd[a]);
+    }
+}
+
+// Смена статуса «жив» у x: меняются только сводки его предков
+static void aggregates_alive_changed(Graph* g, int x, int now_alive) {
+    SearchScratch* sc = &g->scratch;
+    DescendantAggregates* da = &g->aggregates;
+    if (scratch_begin(sc, g->size) != 0) {
+        memset(da->fresh, 0, da->capacity);
+        return;
+    }
+    int n = ancestors_of(g, x, sc->stamp, sc->mark_fwd, sc->dist_fwd, sc->queue_fwd);
+    for (int i = 1; i < n; i++) {
+        int a = sc->queue_fwd[i];
+        if (!da->fresh[a]) continue;
+        double w = heir_weight(sc->dist_fwd[a]);
+        da->items[a].living += now_alive ? 1 : -1;
+        da->items[a].weight += now_alive ? w : -w;
+    }
+}
+
+// Перед удалением x: бездетный x просто вычитается из сводок предков,
+// иначе предки помечаются устаревшими (вместе с x уходят и его потомки)
+static void aggregates_remove_vertex(Graph* g, int x) {
+    DescendantAggregates* da = &g->aggregates;
+    int n = has_children(g, x) ? -1 : aggregates_leaf_begin(g, x);
+    if (n < 0) {
+        aggregates_mark_stale(g, x);
+        return;
+    }
+    SearchScratch* sc = &g->scratch;
+    int alive = is_alive(g, x);
+    for (int i = 1; i < n; i++) {
+        int a = sc->queue_fwd[i];
+        if (!da->fresh[a]) continue;
+        da->items[a].descendants--;
+        da->items[a].living -= alive;
+        if (alive) da->items[a].weight -= heir_weight(sc->dist_fwd[a]);
+    }
+}
+
+int graph_enable_aggregates(Graph* g, int enable) {
+    if (!g) return -1;
+    DescendantAggregates* da = &g->aggregates;
+    if (!enable) {
+        aggregates_free(da);
+        return 0;
+    }
+    // сводки пересчитываются по спискам рёбер
+    if (edges_materialize(g) != 0 || aggregates_reserve(da, g->capacity) != 0) return -1;
+    memset(da->fresh, 0, da->capacity);
+    da->enabled = 1;
+    return 0;
+}
+
+int get_descendant_summary(Graph* g, const char* name, DescendantSummary* out) {
+    if (!g || !name || !out) return -1;
+    int v = name_table_find(g->name_index, name);
+    if (v < 0) return -1;
+    DescendantAggregates* da = &g->aggregates;
+    if (edges_materialize(g) != 0) return -1;
+    if (!da->enabled) return summary_compute(g, v, out);
+    if (!da->fresh[v]) {
+        if (summary_compute(g, v, &da->items[v]) != 0) return -1;
+        da->fresh[v] = 1;
+    }
+    *out = da->items[v];
+    return 0;
+}
+
+int set_death_year(Graph* g, const char* name, int death_year) {
+    if (!g || !name) return -1;
+    int v = name_table_find(g->name_index, name);
+    if (v < 0) return -1;
+    int was_alive = g->people.death_year[v] < 0;
+    g->people.death_year[v] = death_year;
+    g->version++;
+    if (g->lifespan.enabled) lifespan_changed(g, v);
+    if (g->aggregates.enabled && was_alive != (death_year < 0))
+        aggregates_alive_changed(g, v, death_year < 0);
+    return 0;
+}
+
+
+// ----------- Кэш результатов запросов -------------- //
+#define QUERY_CACHE_MAX_IDS (1 << 22) // предел суммарной длины сохранённых списков (16 МБ)
+
+static unsigned long query_key_hash(int op, int a, int b) {
+    unsigned long h = (unsigned long)op * 0x9E3779B1UL;
+    h ^= (unsigned long)a * 0x85EBCA77UL + (h << 6) + (h >> 2);
+    h ^= (unsigned long)(b + 1) * 0xC2B2AE3DUL + (h << 6) + (h >> 2);
+    return h;
+}
+
+// Удаляет все записи, оставляя память и счётчики
+static void query_cache_reset(QueryCache* qc) {
+    for (int i = qc->head; i >= 0; i = qc->entries[i].next) {
+        free(qc->entries[i].ids);
+        qc->entries[i].ids = NULL;
+    }
+    for (int i = 0; i <= qc->bucket_mask; i++) qc->buckets[i] = -1;
+    for (int i = 0; i < qc->capacity; i++) qc->entries[i].chain = i + 1 < qc->capacity ? i + 1 : -1;
+    qc->free_list = 0;
+    qc->head = qc->tail = -1;
+    qc->count = 0;
+    qc->stored_ids = 0;
+}
+
+static void query_cache_free(QueryCache* qc) {
+    if (qc->capacity > 0) query_cache_reset(qc);
+    free(qc->entries);
+    free(qc->buckets);
+    qc->entries = NULL;
+    qc->buckets = NULL;
+    qc->capacity = 0;
+}
+
+static void lru_unlink(QueryCache* qc, int i) {
+    QueryCacheEntry* e = &qc->entries[i];
+    if (e->prev >= 0) qc->entries[e->prev].next = e->next;
+    else qc->head = e->next;
+    if (e->next >= 0) qc->entries[e->next].prev = e->prev;
+    else qc->tail = e->prev;
+}
+
+static void lru_push_front(QueryCache* qc, int i) {
+    QueryCacheEntry* e = &qc->entries[i];
+    e->prev = -1;
+    e->next = qc->head;
+    if (qc->head >= 0) qc->entries[qc->head].prev = i;
+    qc->head = i;
+    if (qc->tail < 0) qc->tail = i;
+}
+
+// Возвращает кэш, очищенный, если граф изменился после сохранения записей,
+// или NULL, если кэш выключен
+static QueryCache* query_cache_sync(Graph* g) {
+    QueryCache* qc = &g->query_cache;
+    if (qc->capacity == 0) return NULL;
+    if (qc->version != g->version) {
+        if (qc->count > 0) {
+            query_cache_reset(qc);
+            qc->invalidations++;
+        }
+        qc->version = g->version;
+    }
+    return qc;
+}
+
+// Ищет результат запроса; найденная запись становится последней использованной
+static const QueryCacheEntry* query_cache_find(Graph* g, int op, int a, int b) {
+    QueryCache* qc = query_cache_sync(g);
+    if (!qc) return NULL;
+    int bucket = (int)(query_key_hash(op, a, b) & qc->bucket_mask);
+    for (int i = qc->buckets[bucket]; i >= 0; i = qc->entries[i].chain) {
+        QueryCacheEntry* e = &qc->entries[i];
+        if (e->op != op || e->a != a || e->b != b) continue;
+        lru_unlink(qc, i);
+        lru_push_front(qc, i);
+        qc->hits++;
+        return e;
+    }
+    qc->misses++;
+    return NULL;
+}
+
+static void query_cache_evict(QueryCache* qc, int i) {
+    QueryCacheEntry* e = &qc->entries[i];
+    int* pp = &qc->buckets[query_key_hash(e->op, e->a, e->b) & qc->bucket_mask];
+    while (*pp != i) pp = &qc->entries[*pp].chain;
+    *pp = e->chain;
+    lru_unlink(qc, i);
+    if (e->ids) qc->stored_ids -= e->value;
+    free(e->ids);
+    e->ids = NULL;
+    e->chain = qc->free_list;
+    qc->free_list = i;
+    qc->count--;
+    qc->evictions++;
+}
+
+// Сохраняет результат запроса (ids копируется). Если места нет, вытесняются
+// давно не использованные записи; слишком длинные списки не сохраняются.
+static void query_cache_put(Graph* g, int op, int a, int b, int value, const int* ids) {
+    QueryCache* qc = query_cache_sync(g);
+    if (!qc) return;
+    long n = ids ? value : 0;
+    if (n > QUERY_CACHE_MAX_IDS) return;
+    while (qc->free_list < 0 || qc->stored_ids + n > QUERY_CACHE_MAX_IDS)
+        query_cache_evict(qc, qc->tail);
+    int* copy = NULL;
+    if (n > 0) {
+        copy = malloc(sizeof(int) * n);
+        if (!copy) return;
+        memcpy(copy, ids, sizeof(int) * n);
+    }
+    int i = qc->free_list;
+    QueryCacheEntry* e = &qc->entries[i];
+    qc->free_list = e->chain;
+    e->op = op;
+    e->a = a;
+    e->b = b;
+    e->value = value;
+    e->ids = copy;
+    int bucket = (int)(query_key_hash(op, a, b) & qc->bucket_mask);
+    e->chain = qc->buckets[bucket];
+    qc->buckets[bucket] = i;
+    lru_push_front(qc, i);
+    qc->count++;
+    qc->stored_ids += n;
+}
+
+int graph_set_query_cache(Graph* g, int entries) {
+    if (!g || entries < 0) return -1;
+    QueryCache* qc = &g->query_cache;
+    query_cache_free(qc);
+    if (entries == 0) return 0;
+    int buckets = 1;
+    while (buckets < 2 * entries) buckets <<= 1;
+    qc->entries = calloc(entries, sizeof(QueryCacheEntry));
+    qc->buckets = malloc(sizeof(int) * buckets);
+    if (!qc->entries || !qc->buckets) {
+        free(qc->entries);
+        free(qc->buckets);
+        qc->entries = NULL;
+        qc->buckets = NULL;
+        return -1;
+    }
+    qc->capacity = entries;
+    qc->bucket_mask = buckets - 1;
+    qc->version = g->version;
+    qc->head = -1;
+    query_cache_reset(qc);
+    return 0;
+}
+
+void graph_query_cache_stats(const Graph* g, QueryCacheStats* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!g) return;
+    const QueryCache* qc = &g->query_cache;
+    out->hits = qc->hits;
+    out->misses = qc->misses;
+    out->evictions = qc->evictions;
+    out->invalidations = qc->invalidations;
+    // записи старой версии графа уже недействительны
+    out->entries = qc->version == g->version ? qc->count : 0;
+    out->capacity = qc->capacity;
+}
+
+
+// ----------- Столбцы людей и выборки по годам -------------- //
+static void columns_free(PersonColumns* c) {
+    if (!c->mapped) {
+        free(c->birth_year);
+        free(c->death_year);
+        free(c->gender);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+// Переносит столбцы из отображённого снимка в собственную память на n элементов
+static int columns_unmap(PersonColumns* c, int n) {
+    int* birth = malloc(sizeof(int) * n);
+    int* death = malloc(sizeof(int) * n);
+    unsigned char* gender = malloc(n);
+    if (!birth || !death || !gender) {
+        free(birth);
+        free(death);
+        free(gender);
+        return -1;
+    }
+    memcpy(birth, c->birth_year, sizeof(int) * c->capacity);
+    memcpy(death, c->death_year, sizeof(int) * c->capacity);
+    memcpy(gender, c->gender, c->capacity);
+    c->birth_year = birth;
+    c->death_year = death;
+    c->gender = gender;
+    c->capacity = n;
+    c->mapped = 0;
+    return 0;
+}
+
+static int columns_reserve(PersonColumns* c, int n) {
+    if (n <= c->capacity) return 0;
+    if (c->mapped) return columns_unmap(c, n);
+    int* birth = realloc(c->birth_year, sizeof(int) * n);
+    if (birth) c->birth_year = birth;
+    int* death = realloc(c->death_year, sizeof(int) * n);
+    if (death) c->death_year = death;
+    unsigned char* gender = realloc(c->gender, n);
+    if (gender) c->gender = gender;
+    if (!birth || !death || !gender) return -1;
+    c->capacity = n;
+    return 0;
+}
+
+// Условие выборки: год рождения в [birth_lo, birth_hi] и год смерти в [death_lo, death_hi].
+// Год смерти живого считается равным INT_MAX; удалённые слоты отсекает birth_lo > INT_MIN.
+typedef struct {
+    int birth_lo, birth_hi;
+    int death_lo, death_hi;
+} YearRange;
+
+static int year_range_match(const YearRange* r, int birth, int death) {
+    int key = death < 0 ? INT_MAX : death;
+    return birth >= r->birth_lo && birth <= r->birth_hi && key >= r->death_lo && key <= r->death_hi;
+}
+
+// Записывает индексы base + k для установленных битов k маски (или только считает их)
+static int emit_lanes(int* out, int count, int base, unsigned bits) {
+    static const unsigned char ones[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    if (!out) return count + ones[bits & 15] + ones[(bits >> 4) & 15];
+    for (int k = 0; bits; k++, bits >>= 1)
+        if (bits & 1) out[count++] = base + k;
+    return count;
+}
+
+// Просматривает столбцы годов первых n слотов. Индексы подходящих людей по
+// возрастанию пишутся в out (out == NULL — только подсчёт).
+// @return Количество подходящих людей.
+static int columns_scan(const PersonColumns* c, int n, const YearRange* r, int* out) {
+    const int* birth = c->birth_year;
+    const int* death = c->death_year;
+    int count = 0, i = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i living = _mm256_set1_epi32(INT_MAX);
+    const __m256i blo = _mm256_set1_epi32(r->birth_lo), bhi = _mm256_set1_epi32(r->birth_hi);
+    const __m256i dlo = _mm256_set1_epi32(r->death_lo), dhi = _mm256_set1_epi32(r->death_hi);
+    for (; i + 8 <= n; i += 8) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(birth + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(death + i));
+        __m256i key = _mm256_blendv_epi8(d, living, _mm256_cmpgt_epi32(zero, d));
+        // промах: год вне диапазона с любой стороны
+        __m256i miss = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(blo, b), _mm256_cmpgt_epi32(b, bhi)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(dlo, key), _mm256_cmpgt_epi32(key, dhi)));
+        unsigned bits = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(miss)) & 0xFFu;
+        count = emit_lanes(out, count, i, bits);
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i living = _mm_set1_epi32(INT_MAX);
+    const __m128i blo = _mm_set1_epi32(r->birth_lo), bhi = _mm_set1_epi32(r->birth_hi);
+    const __m128i dlo = _mm_set1_epi32(r->death_lo), dhi = _mm_set1_epi32(r->death_hi);
+    for (; i + 4 <= n; i += 4) {
+        __m128i b = _mm_loadu_si128((const __m128i*)(birth + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(death + i));
+        __m128i dead = _mm_cmpgt_epi32(zero, d);
+        __m128i key = _mm_or_si128(_mm_and_si128(dead, living), _mm_andnot_si128(dead, d));
+        __m128i miss = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi32(b, blo), _mm_cmpgt_epi32(b, bhi)),
+            _mm_or_si128(_mm_cmplt_epi32(key, dlo), _mm_cmpgt_epi32(key, dhi)));
+        unsigned bits = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(miss)) & 0xFu;
+        count = emit_lanes(out, count, i, bits);
+    }
+#endif
+    for (; i < n; i++) {
+        if (!year_range_match(r, birth[i], death[i])) continue;
+        if (out) out[count] = i;
+        count++;
+    }
+    return count;
+}
+
+// Выборка в новый массив индексов
+static int columns_select(const Graph* g, const YearRange* r, int** out) {
+    STAT_SCOPE(OP_FILTER_PEOPLE);
+    if (!g || !out) return -1;
+    *out = malloc(sizeof(int) * (g->live_count > 0 ? g->live_count : 1));
+    if (!*out) return -1;
+    STAT_EDGES(g->size);
+    return columns_scan(&g->people, g->size, r, *out);
+}
+
+int get_person(const Graph* g, int index, Person* out) {
+    if (!g || !out || index < 0 || index >= g->size || g->vertices[index].removed) return -1;
+    out->name = g->vertices[index].name;
+    out->gender = (Gender)g->people.gender[index];
+    out->birth_year = g->people.birth_year[index];
+    out->death_year = g->people.death_year[index];
+    return 0;
+}
+
+int count_alive(const Graph* g) {
+    STAT_SCOPE(OP_FILTER_PEOPLE);
+    if (!g) return -1;
+    YearRange r = { INT_MIN + 1, INT_MAX, INT_MAX, INT_MAX };
+    STAT_EDGES(g->size);
+    return columns_scan(&g->people, g->size, &r, NULL);
+}
+
+int filter_by_birth_range(const Graph* g, int from, int to, int** out) {
+    YearRange r = { from > INT_MIN ? from : INT_MIN + 1, to, INT_MIN, INT_MAX };
+    return columns_select(g, &r, out);
+}
+
+int alive_in_year(const Graph* g, int year, int** out) {
+    YearRange r = { INT_MIN + 1, year, year, INT_MAX };
+    return columns_select(g, &r, out);
+}
+
+int filter_died_before(const Graph* g, int year, int** out) {
+    YearRange r = { INT_MIN + 1, INT_MAX, INT_MIN, year > INT_MIN ? year - 1 : INT_MIN };
+    // раньше INT_MIN никто не умер: пустой диапазон годов рождения
+    if (year == INT_MIN) r.birth_hi = INT_MIN;
+    return columns_select(g, &r, out);
+}
+
 
-// Очередь (FIFO) — используется для обхода графа (например, BFS)
+// ----------- Буферизованный вывод -------------- //
+// Текст копится в буфере и сбрасывается в поток блоками, а не по строке на printf.
+// Без потока (f == NULL) буфер растёт и весь текст остаётся в памяти.
 typedef struct {
-    QueueNode* front;  // Первый элемент очереди (голова)
-    QueueNode* rear;   // Последний элемент очереди (хвост)
-} Queue;
+    FILE* f;
+    char* buf;
+    size_t used;
+    size_t capacity;
+    int error;
+} TextWriter;
 
+static int text_writer_flush(TextWriter* w) {
+    if (!w->f) return w->error ? -1 : 0;
+    if (w->used > 0 && fwrite(w->buf, 1, w->used, w->f) != w->used) w->error = 1;
+    w->used = 0;
+    return w->error ? -1 : 0;
+}
 
-// ----------- Хэш-таблица -------------- //
-static unsigned long hash_string(const char* str) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c;
-    return hash;
+static void text_put(TextWriter* w, const char* s, size_t len) {
+    if (w->error) return;
+    if (w->used + len > w->capacity && !w->f) {
+        size_t cap = w->capacity * 2;
+        while (cap < w->used + len) cap *= 2;
+        char* tmp = realloc(w->buf, cap);
+        if (!tmp) {
+            w->error = 1;
+            return;
+        }
+        w->buf = tmp;
+        w->capacity = cap;
+    }
+    if (w->used + len > w->capacity) {
+        text_writer_flush(w);
+        if (len > w->capacity) {
+            if (fwrite(s, 1, len, w->f) != len) w->error = 1;
+            return;
+        }
+    }
+    memcpy(w->buf + w->used, s, len);
+    w->used += len;
 }
 
-static NameHashTable* create_name_table() {
-    NameHashTable* ht = malloc(sizeof(NameHashTable));
-    if (!ht) return NULL;
-    ht->capacity = HASH_CAPACITY;
-    ht->table = calloc(ht->capacity, sizeof(NameHashNode*));
-    return ht;
+static void text_put_str(TextWriter* w, const char* s) {
+    text_put(w, s, strlen(s));
 }
 
-static void free_name_table(NameHashTable* ht) {
-    if (!ht) return;
-    for (int i = 0; i < ht->capacity; i++) {
-        NameHashNode* node = ht->table[i];
-        while (node) {
-            NameHashNode* tmp = node;
-            node = node->next;
-            free(tmp->name);
-            free(tmp);
-        }
-    }
-    free(ht->table);
-    free(ht);
+static void text_put_int(TextWriter* w, int v) {
+    char tmp[16];
+    int pos = sizeof(tmp);
+    unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+    do {
+        tmp[--pos] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) tmp[--pos] = '-';
+    text_put(w, tmp + pos, sizeof(tmp) - pos);
 }
 
-static int name_table_insert(NameHashTable* ht, const char* name, int index) {
-    if (!ht || !name) return -1;
-    unsigned long h = hash_string(name) % ht->capacity;
-    NameHashNode* cur = ht->table[h];
-    while (cur) {
-        if (strcmp(cur->name, name) == 0)
-            return -1; // дубликат, выходим
-        cur = cur->next; // идём по цепочке коллизий
-    }
-    NameHashNode* node = malloc(sizeof(NameHashNode));
-    if (!node) return -1;
-    node->name = strdup(name);
-    node->index = index;
-    node->next = ht->table[h];
-    ht->table[h] = node;
-    return 0;
+static int text_writer_open(TextWriter* w, FILE* f, size_t capacity) {
+    w->f = f;
+    w->used = 0;
+    w->capacity = capacity;
+    w->error = 0;
+    w->buf = malloc(capacity);
+    return w->buf ? 0 : -1;
 }
 
-static int name_table_find(NameHashTable* ht, const char* name) {
-    if (!ht || !name) return -1;
-    unsigned long h = hash_string(name) % ht->capacity;
-    NameHashNode* node = ht->table[h];
-    while (node) {
-        if (strcmp(node->name, name) == 0)
-            return node->index;
-        node = node->next;
-    }
-    return -1;
+// Сбрасывает остаток в поток и освобождает буфер
+static int text_writer_close(TextWriter* w) {
+    int rc = text_writer_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+    return rc;
+}
+
+// Число с двумя знаками после запятой (как "%.2f")
+static void text_put_fixed(TextWriter* w, double v) {
+    char tmp[64];
+    int n = snprintf(tmp, sizeof(tmp), "%.2f", v);
+    if (n > 0) text_put(w, tmp, (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1);
 }
 
 
 // ----------- Граф -------------- //
 Graph* create_graph() {
+    stat_register_exit();
     Graph* g = malloc(sizeof(Graph));
     if (!g) return NULL;
     g->size = 0;
+    g->live_count = 0;
+    g->free_slots = NULL;
+    g->free_count = 0;
+    g->free_capacity = 0;
+    g->edge_count = 0;
+    g->arena.head = NULL;
+    g->free_edges = NULL;
+    g->edges_pending = 0;
+    memset(&g->names, 0, sizeof(NamePool));
+    memset(&g->csr, 0, sizeof(CsrView));
+    memset(&g->scratch, 0, sizeof(SearchScratch));
+    memset(&g->traversal, 0, sizeof(LevelTraversal));
+    memset(&g->kinship, 0, sizeof(KinshipIndex));
+    memset(&g->lifespan, 0, sizeof(LifespanIndex));
+    memset(&g->name_search, 0, sizeof(NameSearchIndex));
+    memset(&g->reach, 0, sizeof(ReachabilityIndex));
+    memset(&g->aggregates, 0, sizeof(DescendantAggregates));
+    memset(&g->query_cache, 0, sizeof(QueryCache));
+    g->version = 0;
+    memset(&g->snapshot, 0, sizeof(MappedFile));
+    g->pool = NULL;
+    g->batch_pool = NULL;
+    g->worker_scratch = NULL;
+    g->worker_scratch_count = 0;
     g->capacity = INITIAL_CAPACITY;
     g->vertices = malloc(sizeof(Vertex) * g->capacity);
-    if (!g->vertices) { free(g); return NULL; }
-    g->name_index = create_name_table();
-    if (!g->name_index) { free(g->vertices); free(g); return NULL; }
+    memset(&g->people, 0, sizeof(PersonColumns));
+    if (!g->vertices || columns_reserve(&g->people, g->capacity) != 0) {
+        columns_free(&g->people);
+        free(g->vertices);
+        free(g);
+        return NULL;
+    }
+    g->name_index = create_name_table(&g->vertices);
+    if (!g->name_index) { columns_free(&g->people); free(g->vertices); free(g); return NULL; }
     return g;
 }
 
 void free_graph(Graph* g) {
     if (!g) return;
-    for (int i = 0; i < g->size; i++) {
-        free(g->vertices[i].person.name);
-        Edge* e = g->vertices[i].edges;
-        while (e) { Edge* tmp = e; e = e->next; free(tmp); }
-    }
+    // имена и рёбра (в том числе из списков свободных) лежат в арене и освобождаются поблочно
     free(g->vertices);
+    columns_free(&g->people);
+    free(g->free_slots);
     free_name_table(g->name_index);
+    csr_free(&g->csr);
+    scratch_free(&g->scratch);
+    level_free(&g->traversal);
+    kinship_free(&g->kinship);
+    lifespan_free(&g->lifespan);
+    name_search_free(&g->name_search);
+    reach_free(&g->reach);
+    aggregates_free(&g->aggregates);
+    query_cache_free(&g->query_cache);
+    arena_free(&g->arena);
+    thread_pool_free(g->pool);
+    thread_pool_free(g->batch_pool);
+    for (int i = 0; i < g->worker_scratch_count; i++) scratch_free(&g->worker_scratch[i]);
+    free(g->worker_scratch);
+    unmap_file(&g->snapshot);
     free(g);
 }
 
 int find_person_index(Graph* g, const char* name) {
+    STAT_SCOPE(OP_FIND_PERSON);
     if (!g) return -1;
     return name_table_find(g->name_index, name);
 }
 
+int find_person_index_n(Graph* g, const char* name, size_t len) {
+    STAT_SCOPE(OP_FIND_PERSON);
+    if (!g) return -1;
+    return name_table_find_n(g->name_index, name, len);
+}
+
+// Увеличивает вместимость массива вершин и столбцов людей до new_cap
+static int graph_grow(Graph* g, int new_cap) {
+    Vertex* tmp = realloc(g->vertices, sizeof(Vertex) * new_cap);
+    if (!tmp) return -1;
+    g->vertices = tmp;
+    if (columns_reserve(&g->people, new_cap) != 0) return -1;
+    STAT_COUNT(CNT_VERTEX_GROWS, 1);
+    g->capacity = new_cap;
+    return 0;
+}
+
+int graph_reserve(Graph* g, int persons) {
+    if (!g || persons <= 0) return 0;
+    if (g->size + persons > g->capacity) {
+        int new_cap = g->capacity;
+        while (new_cap < g->size + persons) new_cap *= 2;
+        if (graph_grow(g, new_cap) != 0) return -1;
+    }
+    return name_table_reserve(g->name_index, persons);
+}
+
 int add_person(Graph* g, Person p) {
+    STAT_SCOPE(OP_ADD_PERSON);
     if (!g || !p.name) return -1;
-    if (find_person_index(g, p.name) != -1) return -1;
-    if (g->size >= g->capacity) {
-        int new_cap = g->capacity * 2;
-        Vertex* tmp = realloc(g->vertices, sizeof(Vertex) * new_cap);
-        if (!tmp) return -1;
-        g->vertices = tmp;
-        g->capacity = new_cap;
-    }
-    Vertex* v = &g->vertices[g->size];
-    v->person.name = strdup(p.name);
-    v->person.gender = p.gender;
-    v->person.birth_year = p.birth_year;
-    v->person.death_year = p.death_year;
-    v->edges = NULL;
-    if (name_table_insert(g->name_index, v->person.name, g->size) != 0) {
-        free(v->person.name);
+    if (name_table_find(g->name_index, p.name) != -1) return -1;
+    if (edges_materialize(g) != 0) return -1;
+    // сначала пробуем занять слот, освобождённый remove_person
+    int idx = g->free_count > 0 ? g->free_slots[g->free_count - 1] : g->size;
+    if (idx == g->size && g->size >= g->capacity && graph_grow(g, g->capacity * 2) != 0) return -1;
+    if (g->aggregates.enabled && aggregates_reserve(&g->aggregates, idx + 1) != 0) return -1;
+    if (g->lifespan.enabled && delta_reserve(&g->lifespan.delta, idx + 1) != 0) return -1;
+    if (g->name_search.enabled && delta_reserve(&g->name_search.delta, idx + 1) != 0) return -1;
+    Vertex* v = &g->vertices[idx];
+    char* name = name_alloc(g, p.name);
+    if (!name) return -1;
+    if (name_table_insert(g->name_index, name, idx) != 0) {
+        name_free(&g->names, name);
         return -1;
     }
-    g->size++;
-    return g->size - 1;
+    v->name = name;
+    g->people.gender[idx] = (unsigned char)p.gender;
+    // год INT_MIN зарезервирован под удалённые слоты
+    g->people.birth_year[idx] = p.birth_year == REMOVED_BIRTH_YEAR ? INT_MIN + 1 : p.birth_year;
+    g->people.death_year[idx] = p.death_year;
+    v->edges = NULL;
+    v->in_edges = NULL;
+    v->removed = 0;
+    if (g->aggregates.enabled) {
+        // у нового человека нет потомков
+        memset(&g->aggregates.items[idx], 0, sizeof(DescendantSummary));
+        g->aggregates.fresh[idx] = 1;
+    }
+    if (idx == g->size) g->size++;
+    else g->free_count--;
+    g->live_count++;
+    if (g->lifespan.enabled) lifespan_changed(g, idx);
+    if (g->name_search.enabled) name_search_added(g, idx);
+    graph_invalidate(g);
+    return idx;
 }
 
 int add_relation(Graph* g, const char* from, const char* to, RelationType relation) {
+    STAT_SCOPE(OP_ADD_RELATION);
     if (!g||!from||!to) return -1;
-    int fi = find_person_index(g, from);
-    int ti = find_person_index(g, to);
+    int fi = name_table_find(g->name_index, from);
+    int ti = name_table_find(g->name_index, to);
     if (fi<0||ti<0) return -1;
-    Edge* edge = malloc(sizeof(Edge));
+    return add_relation_index(g, fi, ti, relation);
+}
+
+int add_relation_index(Graph* g, int fi, int ti, RelationType relation) {
+    if (!g || fi < 0 || ti < 0 || fi >= g->size || ti >= g->size) return -1;
+    if (g->vertices[fi].removed || g->vertices[ti].removed) return -1;
+    if (edges_materialize(g) != 0) return -1;
+    Edge* edge = edge_alloc(g);
     if (!edge) return -1;
+    // число предков листа до изменения или -1, если сводки пересчитываются целиком
+    int leaf = -1;
+    int track = relation == PARENT && g->aggregates.enabled;
+    if (track && fi != ti && !has_children(g, ti)) leaf = aggregates_leaf_begin(g, ti);
+    edge->from = fi;
     edge->to = ti;
     edge->relation = relation;
     edge->next = g->vertices[fi].edges;
     g->vertices[fi].edges = edge;
+    edge->next_in = g->vertices[ti].in_edges;
+    g->vertices[ti].in_edges = edge;
+    g->edge_count++;
+    if (leaf >= 0) aggregates_leaf_end(g, ti, leaf);
+    else if (track) aggregates_mark_stale(g, fi);
+    graph_invalidate(g);
     return 0;
 }
 
+// Исключает ребро из списка входящих рёбер его цели
+static void unlink_in_edge(Graph* g, Edge* edge) {
+    Edge** pp = &g->vertices[edge->to].in_edges;
+    while (*pp && *pp != edge) pp = &(*pp)->next_in;
+    if (*pp) *pp = edge->next_in;
+}
+
+// Исключает ребро из списка исходящих рёбер его источника
+static void unlink_out_edge(Graph* g, Edge* edge) {
+    Edge** pp = &g->vertices[edge->from].edges;
+    while (*pp && *pp != edge) pp = &(*pp)->next;
+    if (*pp) *pp = edge->next;
+}
+
 // --- Удаление ребра ---
 int remove_relation(Graph* g, const char* from, const char* to, RelationType relation) {
+    STAT_SCOPE(OP_REMOVE_RELATION);
     if (!g||!from||!to) return -1;
-    int fi = find_person_index(g, from);
-    int ti = find_person_index(g, to);
+    if (edges_materialize(g) != 0) return -1;
+    int fi = name_table_find(g->name_index, from);
+    int ti = name_table_find(g->name_index, to);
     if (fi<0||ti<0) return -1;
     Edge** pp = &g->vertices[fi].edges;
     while (*pp) {
         Edge* cur = *pp;
         if (cur->to==ti && cur->relation==relation) {
+            int leaf = -1;
+            int track = relation == PARENT && g->aggregates.enabled;
+            if (track && fi != ti && !has_children(g, ti)) leaf = aggregates_leaf_begin(g, ti);
+            // предки fi до удаления — все, чьи сводки могут измениться
+            if (track && leaf < 0) aggregates_mark_stale(g, fi);
             *pp = cur->next;
-            free(cur);
+            unlink_in_edge(g, cur);
+            edge_release(g, cur);
+            g->edge_count--;
+            if (leaf >= 0) aggregates_leaf_end(g, ti, leaf);
+            graph_invalidate(g);
             return 0;
         }
         pp = &cur->next;
@@ -180,287 +2760,803 @@ int remove_relation(Graph* g, const char* from, const char* to, RelationType rel
 
 // --- Удаление вершины ---
 int remove_person(Graph* g, const char* name) {
+    STAT_SCOPE(OP_REMOVE_PERSON);
     if (!g||!name) return -1;
-    int idx = find_person_index(g, name);
+    int idx = name_table_find(g->name_index, name);
     if (idx<0) return -1;
-    // Удаляем все исходящие ребра
-    Edge* e = g->vertices[idx].edges;
-    while (e) { Edge* tmp = e; e = e->next; free(tmp); }
-    // Удаляем все входящие ребра
-    for (int i = 0; i < g->size; i++) {
-        if (i==idx) continue;
-        Edge** pp = &g->vertices[i].edges;
-        while (*pp) {
-            Edge* cur = *pp;
-            if (cur->to == idx) {
-                *pp = cur->next;
-                free(cur);
-            } else pp = &cur->next;
-        }
-    }
-    // Освобождаем имя
-    free(g->vertices[idx].person.name);
-    // Сдвигаем массив вершин
-    for (int i = idx; i < g->size-1; i++) {
-        g->vertices[i] = g->vertices[i+1];
-    }
-    g->size--;
-    // Перестраиваем хэш-таблицу
-    free_name_table(g->name_index);
-    g->name_index = create_name_table();
-    for (int i = 0; i < g->size; i++) {
-        name_table_insert(g->name_index, g->vertices[i].person.name, i);
+    if (edges_materialize(g) != 0) return -1;
+    if (g->free_count >= g->free_capacity) {
+        int new_cap = g->free_capacity ? g->free_capacity * 2 : INITIAL_CAPACITY;
+        int* tmp = realloc(g->free_slots, sizeof(int) * new_cap);
+        if (!tmp) return -1;
+        g->free_slots = tmp;
+        g->free_capacity = new_cap;
+    }
+    Vertex* v = &g->vertices[idx];
+    if (g->aggregates.enabled) aggregates_remove_vertex(g, idx);
+    // Удаляем все исходящие ребра (заодно из списков входящих у детей)
+    Edge* e = v->edges;
+    while (e) {
+        Edge* tmp = e;
+        e = e->next;
+        if (tmp->to != idx) unlink_in_edge(g, tmp);
+        edge_release(g, tmp);
+        g->edge_count--;
     }
+    // Удаляем все входящие ребра (петли уже удалены вместе с исходящими)
+    e = v->in_edges;
+    while (e) {
+        Edge* tmp = e;
+        e = e->next_in;
+        if (tmp->from == idx) continue;
+        unlink_out_edge(g, tmp);
+        edge_release(g, tmp);
+        g->edge_count--;
+    }
+    v->edges = NULL;
+    v->in_edges = NULL;
+    name_table_remove(g->name_index, v->name);
+    name_release(g, v->name);
+    v->name = (char*)"";
+    v->removed = 1;
+    g->people.birth_year[idx] = REMOVED_BIRTH_YEAR;
+    if (g->lifespan.enabled) delta_unlink(&g->lifespan.delta, idx);
+    if (g->name_search.enabled) delta_unlink(&g->name_search.delta, idx);
+    g->free_slots[g->free_count++] = idx;
+    g->live_count--;
+    graph_invalidate(g);
     return 0;
 }
 
-// --- Алгоритм Флойда-Уоршелла --- //
-static int** floyd_warshall(Graph* g) { // двойной указатель потому что возвращаем матрицу расстояний - двумерный массив
-    int n = g->size;
-    int** dist = malloc(n * sizeof(int*));
-    for (int i = 0; i < n; i++) {
-        dist[i] = malloc(n * sizeof(int));
-        for (int j = 0; j < n; j++) {
-            dist[i][j] = (i == j ? 0 : INF);
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// --- Доли наследства (BFS по рёбрам с relation == PARENT) --- //
+// Обходит потомков start в буферах sc и делит amount между живыми: вес потомка
+// в d поколениях — 1 / 2^(d-1). Доли возвращаются по возрастанию индекса
+// (в том же порядке складываются веса). *out освобождается вызывающим.
+// @return Количество долей или -1 при ошибке памяти.
+static int inheritance_shares(const Graph* g, const CsrView* csr, SearchScratch* sc,
+                              int start, double amount, InheritanceShare** out) {
+    *out = NULL;
+    if (scratch_begin(sc, g->size) != 0) return -1;
+    int head = 0, tail = 0;
+    sc->mark_fwd[start] = sc->stamp;
+    sc->dist_fwd[start] = 0;
+    sc->queue_fwd[tail++] = start;
+    while (head < tail) {
+        int current = sc->queue_fwd[head++];
+        STAT_EDGES(csr->offsets[current + 1] - csr->offsets[current]);
+        for (int k = csr->offsets[current]; k < csr->offsets[current + 1]; k++) {
+            if (csr->relation[k] != PARENT) continue;
+            int child = csr->to[k];
+            if (sc->mark_fwd[child] == sc->stamp) continue;
+            sc->mark_fwd[child] = sc->stamp;
+            sc->dist_fwd[child] = sc->dist_fwd[current] + 1;
+            sc->queue_fwd[tail++] = child;
         }
     }
-    // инициализация по рёбрам
-    for (int i = 0; i < n; i++) {
-        Edge* e = g->vertices[i].edges;
-        while (e) {
-            dist[i][e->to] = 1;
-            e = e->next;
-        }
-    }
-    // основной цикл
-    for (int k = 0; k < n; k++) {
-        for (int i = 0; i < n; i++) {
-            if (dist[i][k] == INF) continue;
-            for (int j = 0; j < n; j++) {
-                if (dist[k][j] == INF) continue;
-                if (dist[i][k] + dist[k][j] < dist[i][j]) { // если нашли более короткий путь
-                    // обновляем расстояние
-                    dist[i][j] = dist[i][k] + dist[k][j];
-                }
-            }
-        }
+    // живые потомки (сам наследодатель в queue_fwd[0] не входит)
+    int heirs = 0;
+    for (int i = 1; i < tail; i++) {
+        int v = sc->queue_fwd[i];
+        if (g->people.death_year[v] < 0) sc->queue_fwd[heirs++] = v;
     }
-    return dist;
+    if (heirs == 0) return 0;
+    qsort(sc->queue_fwd, heirs, sizeof(int), compare_ints);
+    InheritanceShare* shares = malloc(sizeof(InheritanceShare) * heirs);
+    if (!shares) return -1;
+    double total_weight = 0.0;
+    for (int i = 0; i < heirs; i++) {
+        int v = sc->queue_fwd[i];
+        // вес = 1 / 2^(d-1)
+        double w = 1.0 / pow(2.0, sc->dist_fwd[v] - 1);
+        shares[i].person = v;
+        shares[i].share = w;
+        total_weight += w;
+    }
+    double base = amount / total_weight;
+    for (int i = 0; i < heirs; i++) shares[i].share *= base;
+    *out = shares;
+    return heirs;
 }
 
 
 // --- Распределение наследства --- //
+// Доли наследства name; *out освобождается вызывающим.
+// @return Количество долей, -1 при ошибке памяти или -2, если человек не найден.
+static int shares_of(Graph* g, const char* name, double amount, InheritanceShare** out) {
+    *out = NULL;
+    int start = name_table_find(g->name_index, name);
+    if (start == -1) return -2;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    return inheritance_shares(g, csr, &g->scratch, start, amount, out);
+}
+
+int compute_inheritance(Graph* g, const char* name, double amount, InheritanceShare* out, int capacity) {
+    STAT_SCOPE(OP_INHERITANCE);
+    if (!g || !name || capacity < 0 || (capacity > 0 && !out)) return -1;
+    InheritanceShare* shares;
+    int count = shares_of(g, name, amount, &shares);
+    if (count < 0) return -1;
+    int copied = count < capacity ? count : capacity;
+    if (copied > 0) memcpy(out, shares, sizeof(InheritanceShare) * copied);
+    free(shares);
+    return count;
+}
+
 void distribute_inheritance(Graph* g, const char* name, double amount) {
-    int start = find_person_index(g, name);
-    if (start == -1) {
+    STAT_SCOPE(OP_INHERITANCE);
+    if (!g) return;
+    InheritanceShare* shares;
+    int count = shares_of(g, name, amount, &shares);
+    if (count == -2) {
         printf(RED "Человек '%s' не найден\n" RESET, name);
         return;
     }
-    int n = g->size;
+    if (count < 0) return;
+    if (count == 0) {
+        printf(RED "Нет живых потомков, которые могли бы распределить наследство\n" RESET);
+        return;
+    }
+    printf("Распределение наследства с '%s' (total: %.2f):\n", name, amount);
+    TextWriter w;
+    if (text_writer_open(&w, stdout, PRINT_BUFFER_SIZE) == 0) {
+        for (int i = 0; i < count; i++) {
+            text_put(&w, " - ", 3);
+            text_put_str(&w, g->vertices[shares[i].person].name);
+            text_put(&w, ": ", 2);
+            text_put_fixed(&w, shares[i].share);
+            text_put(&w, "\n", 1);
+        }
+        text_writer_close(&w);
+    }
+    free(shares);
+}
 
-    // получаем матрицу кратчайших путей
-    int** dist = floyd_warshall(g);
 
-    // вычисляем веса и суммарный вес
-    double total_weight = 0.0;
-    double* weights = calloc(n, sizeof(double));
-    for (int i = 0; i < n; i++) {
-        if (i == start) continue;
-        int d = dist[start][i];
-        // потомки: путь должен быть конечным и >0, а человек жив
-        if (d < INF && d > 0 && g->vertices[i].person.death_year < 0) {
-            // вес = 1 / 2^(d-1)
-            double w = 1.0 / pow(2.0, d - 1);
-            weights[i] = w;
-            total_weight += w;
-        }
+
+// Печатает людей списком через буфер (в тот же stdout, что и printf)
+static void print_people(const Graph* g, const int* ids, int count) {
+    TextWriter w;
+    if (count == 0 || text_writer_open(&w, stdout, PRINT_BUFFER_SIZE) != 0) return;
+    for (int i = 0; i < count; i++) {
+        text_put(&w, " - ", 3);
+        text_put_str(&w, g->vertices[ids[i]].name);
+        text_put(&w, "\n", 1);
     }
+    text_writer_close(&w);
+}
 
-    if (total_weight == 0.0) {
-        printf(RED "Нет живых потомков, которые могли бы распределить наследство\n" RESET);
-    } else {
-        double base = amount / total_weight;
-        printf("Распределение наследства с '%s' (total: %.2f):\n", name, amount);
-        for (int i = 0; i < n; i++) {
-            if (weights[i] > 0) {
-                double share = base * weights[i];
-                printf(" - %s: %.2f\n", g->vertices[i].person.name, share);
-            }
-        }
+// --- Потомки и предки (обход по уровням по рёбрам с relation == PARENT) --- //
+// Потомки (down = 1) или предки name, кроме него самого, в порядке обхода: из кэша
+// или обходом по уровням (тогда результат кэшируется). Массив принадлежит кэшу или g->traversal.
+// @return Индексы или NULL; *count — их количество, -1 при ошибке памяти, -2, если человек не найден.
+static const int* relatives(Graph* g, const char* name, int down, int* count) {
+    static const int no_ids[1] = { 0 };
+    *count = -2;
+    int start_idx = name_table_find(g->name_index, name);
+    if (start_idx == -1) return NULL;
+    *count = -1;
+    CachedQuery kind = down ? CACHED_DESCENDANTS : CACHED_ANCESTORS;
+    const QueryCacheEntry* hit = query_cache_find(g, kind, start_idx, -1);
+    if (hit) {
+        *count = hit->value;
+        return hit->ids ? hit->ids : no_ids;
+    }
+
+    const CsrView* csr = graph_view(g);
+    if (!csr) return NULL;
+    int n = level_traverse(g, csr, start_idx, down);
+    if (n < 0) return NULL;
+    const int* found = g->traversal.order + 1;
+    query_cache_put(g, kind, start_idx, -1, n - 1, found);
+    *count = n - 1;
+    return found;
+}
+
+// Печатает потомков (down = 1) или предков name
+static void print_relatives(Graph* g, const char* name, int down) {
+    int count;
+    const int* ids = relatives(g, name, down, &count);
+    if (count == -2) {
+        printf(RED "Человек '%s' не найден.\n" RESET, name);
+        return;
     }
+    if (!ids) return;
+    printf(down ? "Потомки от '%s':\n" : "Предки '%s':\n", name);
+    print_people(g, ids, count);
+}
 
-    // очистка
-    for (int i = 0; i < n; i++) free(dist[i]);
-    free(dist);
-    free(weights);
+void get_descendants(Graph* g, const char* name) {
+    STAT_SCOPE(OP_GET_DESCENDANTS);
+    if (!g) return;
+    print_relatives(g, name, 1);
 }
 
+const int* relatives_view(Graph* g, const char* name, int down, int* count) {
+    STAT_SCOPE(down ? OP_GET_DESCENDANTS : OP_GET_ANCESTORS);
+    int n = 0;
+    const int* ids = g && name ? relatives(g, name, down, &n) : NULL;
+    if (count) *count = ids ? n : 0;
+    return ids;
+}
 
+int find_relatives(Graph* g, const char* name, int down, int* ids, int capacity) {
+    STAT_SCOPE(down ? OP_GET_DESCENDANTS : OP_GET_ANCESTORS);
+    if (!g || !name || capacity < 0 || (capacity > 0 && !ids)) return -1;
+    int count;
+    const int* found = relatives(g, name, down, &count);
+    if (!found) return -1;
+    int copied = count < capacity ? count : capacity;
+    if (copied > 0) memcpy(ids, found, sizeof(int) * copied);
+    return count;
+}
 
-// --- Остальные функции (BFS, Dijkstra и пр.) --- //
+// Обходит по уровням от name; результат (с самим человеком в order[0]) — в g->traversal.
+// @return Количество найденных людей вместе с ним или -1.
+static int traverse_from(Graph* g, const char* name, int down) {
+    int start_idx = name_table_find(g->name_index, name);
+    if (start_idx < 0) return -1;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    return level_traverse(g, csr, start_idx, down);
+}
 
-static void enqueue(Queue* q, int idx) {
-    QueueNode* node = malloc(sizeof(QueueNode));
-    node->index = idx;
-    node->next = NULL;
-    if (!q->rear) {
-        q->front = q->rear = node;
-    } else {
-        q->rear->next = node;
-        q->rear = node;
+int find_relatives_depth(Graph* g, const char* name, int down, PersonDepth* out, int capacity) {
+    STAT_SCOPE(down ? OP_GET_DESCENDANTS : OP_GET_ANCESTORS);
+    if (!g || !name || capacity < 0 || (capacity > 0 && !out)) return -1;
+    int count = traverse_from(g, name, down);
+    if (count < 0) return -1;
+    const LevelTraversal* lt = &g->traversal;
+    // уровень 0 — сам человек: он в результат не входит
+    int written = 0;
+    for (int d = 1; d < lt->levels && written < capacity; d++) {
+        for (int i = lt->level_start[d]; i < lt->level_start[d + 1] && written < capacity; i++) {
+            out[written].person = lt->order[i];
+            out[written].depth = d;
+            written++;
+        }
     }
+    return count - 1;
 }
 
+int visit_relatives(Graph* g, const char* name, int down, PersonVisitor visit, void* ctx) {
+    STAT_SCOPE(down ? OP_GET_DESCENDANTS : OP_GET_ANCESTORS);
+    if (!g || !name || !visit) return -1;
+    if (traverse_from(g, name, down) < 0) return -1;
+    const LevelTraversal* lt = &g->traversal;
+    int calls = 0;
+    for (int d = 1; d < lt->levels; d++) {
+        for (int i = lt->level_start[d]; i < lt->level_start[d + 1]; i++) {
+            calls++;
+            if (visit(ctx, lt->order[i], d) != 0) return calls;
+        }
+    }
+    return calls;
+}
 
+int get_generations(Graph* g, const char* name, int down, GenerationLevels* out) {
+    STAT_SCOPE(OP_GET_GENERATIONS);
+    if (!g || !name || !out) return -1;
+    memset(out, 0, sizeof(*out));
+    int count = traverse_from(g, name, down);
+    if (count < 0) return -1;
+    const LevelTraversal* lt = &g->traversal;
+    out->ids = malloc(sizeof(int) * (count > 1 ? count - 1 : 1));
+    out->level_start = malloc(sizeof(int) * lt->levels);
+    if (!out->ids || !out->level_start) {
+        free_generation_levels(out);
+        return -1;
+    }
+    memcpy(out->ids, lt->order + 1, sizeof(int) * (count - 1));
+    for (int d = 0; d < lt->levels; d++) out->level_start[d] = lt->level_start[d + 1] - 1;
+    out->count = count - 1;
+    out->generations = lt->levels - 1;
+    return 0;
+}
 
-static int dequeue(Queue* q) {
-    if (!q->front) return -1;
-    QueueNode* node = q->front;
-    int idx = node->index;
-    q->front = node->next;
-    if (!q->front) q->rear = NULL;
-    free(node);
-    return idx;
+void free_generation_levels(GenerationLevels* gl) {
+    if (!gl) return;
+    free(gl->ids);
+    free(gl->level_start);
+    memset(gl, 0, sizeof(*gl));
 }
 
 
 
-static int is_empty(Queue* q) {
-    return q->front == NULL;
+// --- Кратчайший путь: двунаправленный BFS --- //
+// Раскрывает один полный уровень фронта. Если новая вершина уже посещена
+// встречным фронтом, обновляет best суммарной длиной пути через неё.
+static int expand_level(const int* offs, const int* adj,
+                        int* queue, int* head, int* tail,
+                        unsigned int* mark, int* dist,
+                        const unsigned int* other_mark, const int* other_dist,
+                        unsigned int stamp, int best) {
+    int level_end = *tail;
+    while (*head < level_end) {
+        int u = queue[(*head)++];
+        STAT_EDGES(offs[u + 1] - offs[u]);
+        for (int k = offs[u]; k < offs[u + 1]; k++) {
+            int v = adj[k];
+            if (mark[v] == stamp) continue;
+            mark[v] = stamp;
+            dist[v] = dist[u] + 1;
+            if (other_mark[v] == stamp) {
+                int len = dist[v] + other_dist[v];
+                if (best < 0 || len < best) best = len;
+            }
+            queue[(*tail)++] = v;
+        }
+    }
+    return best;
 }
 
+static int bidirectional_distance(const CsrView* csr, SearchScratch* sc, int start, int end) {
+    if (start == end) return 0;
+    unsigned int stamp = sc->stamp;
+    int fh = 0, ft = 0, bh = 0, bt = 0;
+    sc->mark_fwd[start] = stamp;
+    sc->dist_fwd[start] = 0;
+    sc->queue_fwd[ft++] = start;
+    sc->mark_bwd[end] = stamp;
+    sc->dist_bwd[end] = 0;
+    sc->queue_bwd[bt++] = end;
 
-// --- Получение потомков (BFS по ребрам с relation == PARENT) --- //
-void get_descendants(Graph* g, const char* name) {
-    int start_idx = find_person_index(g, name);
-    if (start_idx == -1) {
-        printf(RED "Человек '%s' не найден.\n" RESET, name);
-        return;
+    int best = -1;
+    while (fh < ft && bh < bt) {
+        // раскрываем меньший фронт, уровень целиком: первая встреча на уровне
+        // не обязательно кратчайшая, но минимум по уровню — кратчайший
+        if (ft - fh <= bt - bh)
+            best = expand_level(csr->offsets, csr->to, sc->queue_fwd, &fh, &ft,
+                                sc->mark_fwd, sc->dist_fwd, sc->mark_bwd, sc->dist_bwd,
+                                stamp, best);
+        else
+            best = expand_level(csr->in_offsets, csr->in_from, sc->queue_bwd, &bh, &bt,
+                                sc->mark_bwd, sc->dist_bwd, sc->mark_fwd, sc->dist_fwd,
+                                stamp, best);
+        if (best >= 0) break;
     }
+    return best;
+}
 
-    int* visited = calloc(g->size, sizeof(int));
-    if (!visited) return;
-
-    Queue q = {0};
-    enqueue(&q, start_idx);
-    visited[start_idx] = 1;
-
-    printf("Потомки от '%s':\n", name);
-    while (!is_empty(&q)) {
-        int current = dequeue(&q);
-        Edge* e = g->vertices[current].edges;
-        while (e) {
-            if (e->relation == PARENT) {
-                int child_idx = e->to;
-                if (!visited[child_idx]) {
-                    visited[child_idx] = 1;
-                    printf(" - %s\n", g->vertices[child_idx].person.name);
-                    enqueue(&q, child_idx);
-                }
-            }
-            e = e->next;
+void get_ancestors(Graph* g, const char* name) {
+    STAT_SCOPE(OP_GET_ANCESTORS);
+    if (!g) return;
+    print_relatives(g, name, 0);
+}
+
+// Собирает предков вершины обходом графа (для цикличных графов без индекса).
+// Результат отсортирован по индексу предка; освобождается вызывающим.
+static int collect_ancestors(Graph* g, const CsrView* csr, int v, AncestorEntry** out) {
+    if (scratch_begin(&g->scratch, g->size) != 0) return -1;
+    SearchScratch* sc = &g->scratch;
+    int head = 0, tail = 0;
+    sc->mark_fwd[v] = sc->stamp;
+    sc->dist_fwd[v] = 0;
+    sc->queue_fwd[tail++] = v;
+    while (head < tail) {
+        int u = sc->queue_fwd[head++];
+        STAT_EDGES(csr->in_offsets[u + 1] - csr->in_offsets[u]);
+        for (int k = csr->in_offsets[u]; k < csr->in_offsets[u + 1]; k++) {
+            int p = csr->in_from[k];
+            if (csr->in_relation[k] != PARENT || sc->mark_fwd[p] == sc->stamp) continue;
+            sc->mark_fwd[p] = sc->stamp;
+            sc->dist_fwd[p] = sc->dist_fwd[u] + 1;
+            sc->queue_fwd[tail++] = p;
+        }
+    }
+    // сама вершина (queue_fwd[0]) в список предков не входит
+    AncestorEntry* list = malloc(sizeof(AncestorEntry) * (tail > 1 ? tail - 1 : 1));
+    if (!list) return -1;
+    for (int i = 1; i < tail; i++) {
+        list[i - 1].ancestor = sc->queue_fwd[i];
+        list[i - 1].depth = sc->dist_fwd[sc->queue_fwd[i]];
+    }
+    *out = list;
+    return normalize_ancestors(list, tail - 1);
+}
+
+// Учитывает общего предка x, если он ближе найденного ранее
+static void consider_common_ancestor(Kinship* best, int x, int da, int db) {
+    if (best->ancestor >= 0) {
+        int cur = best->depth_a + best->depth_b;
+        if (da + db > cur) return;
+        if (da + db == cur) {
+            int cur_max = best->depth_a > best->depth_b ? best->depth_a : best->depth_b;
+            int new_max = da > db ? da : db;
+            if (new_max >= cur_max) return;
+        }
+    }
+    best->ancestor = x;
+    best->depth_a = da;
+    best->depth_b = db;
+}
+
+// Слияние двух отсортированных списков предков; сами a и b считаются предками глубины 0
+static void merge_common_ancestors(int a, const AncestorEntry* la, int na,
+                                   int b, const AncestorEntry* lb, int nb, Kinship* best) {
+    for (int i = 0; i < nb; i++)
+        if (lb[i].ancestor == a) consider_common_ancestor(best, a, 0, lb[i].depth);
+    for (int i = 0; i < na; i++)
+        if (la[i].ancestor == b) consider_common_ancestor(best, b, la[i].depth, 0);
+    int i = 0, j = 0;
+    while (i < na && j < nb) {
+        if (la[i].ancestor < lb[j].ancestor) i++;
+        else if (la[i].ancestor > lb[j].ancestor) j++;
+        else {
+            consider_common_ancestor(best, la[i].ancestor, la[i].depth, lb[j].depth);
+            i++;
+            j++;
         }
     }
-    free(visited);
 }
 
+int find_kinship(Graph* g, const char* a, const char* b, Kinship* out) {
+    STAT_SCOPE(OP_FIND_KINSHIP);
+    if (!out) return -1;
+    out->ancestor = -1;
+    out->depth_a = out->depth_b = -1;
+    if (!g || !a || !b) return -1;
+    int ia = name_table_find(g->name_index, a);
+    int ib = name_table_find(g->name_index, b);
+    if (ia < 0 || ib < 0) return -1;
+    if (ia == ib) {
+        out->ancestor = ia;
+        out->depth_a = out->depth_b = 0;
+        return 0;
+    }
+    const KinshipIndex* ki = kinship_view(g);
+    if (ki) {
+        merge_common_ancestors(ia, ki->entries + ki->start[ia], ki->count[ia],
+                               ib, ki->entries + ki->start[ib], ki->count[ib], out);
+    } else {
+        const CsrView* csr = graph_view(g);
+        if (!csr) return -1;
+        AncestorEntry *la = NULL, *lb = NULL;
+        int na = collect_ancestors(g, csr, ia, &la);
+        int nb = na < 0 ? -1 : collect_ancestors(g, csr, ib, &lb);
+        if (na >= 0 && nb >= 0)
+            merge_common_ancestors(ia, la, na, ib, lb, nb, out);
+        free(la);
+        free(lb);
+        if (na < 0 || nb < 0) return -1;
+    }
+    return out->ancestor >= 0 ? 0 : -1;
+}
+
+// Обход от a по рёбрам PARENT с поиском b. В интервальном режиме поддеревья,
+// чьи метки не покрывают post[b], отсекаются, а попадание в поддерево остовного
+// леса сразу даёт ответ.
+static int reach_search(Graph* g, const CsrView* csr, int a, int b) {
+    const ReachabilityIndex* ri = g->reach.valid && g->reach.mode == REACH_INTERVAL ? &g->reach : NULL;
+    if (scratch_begin(&g->scratch, g->size) != 0) return -1;
+    SearchScratch* sc = &g->scratch;
+    int head = 0, tail = 0;
+    sc->mark_fwd[a] = sc->stamp;
+    sc->queue_fwd[tail++] = a;
+    while (head < tail) {
+        int u = sc->queue_fwd[head++];
+        if (ri) {
+            int pb = ri->post[b];
+            if (pb < ri->low[u] || pb > ri->post[u]) continue;
+            if (u != a && pb >= ri->tree_low[u]) return 1;
+            if (u == a && pb >= ri->tree_low[u] && pb < ri->post[u]) return 1;
+        }
+        STAT_EDGES(csr->offsets[u + 1] - csr->offsets[u]);
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int c = csr->to[k];
+            if (csr->relation[k] != PARENT || sc->mark_fwd[c] == sc->stamp) continue;
+            if (c == b) return 1;
+            sc->mark_fwd[c] = sc->stamp;
+            sc->queue_fwd[tail++] = c;
+        }
+    }
+    return 0;
+}
 
+int is_descendant(Graph* g, const char* ancestor, const char* person) {
+    STAT_SCOPE(OP_IS_DESCENDANT);
+    if (!g || !ancestor || !person) return -1;
+    int a = name_table_find(g->name_index, ancestor);
+    int b = name_table_find(g->name_index, person);
+    if (a < 0 || b < 0) return -1;
+    ReachabilityIndex* ri = &g->reach;
+    if (ri->enabled && !ri->valid) reach_build(g);
+    if (ri->valid && ri->mode == REACH_BITSET) {
+        const uint64_t* row = ri->bits + (size_t)a * ri->words;
+        return (int)((row[b >> 6] >> (b & 63)) & 1);
+    }
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    return reach_search(g, csr, a, b);
+}
 
 int shortest_relation_path(Graph* g, const char* from, const char* to) {
-    int start = find_person_index(g, from);
-    int end = find_person_index(g, to);
+    STAT_SCOPE(OP_SHORTEST_PATH);
+    if (!g) return -1;
+    int start = name_table_find(g->name_index, from);
+    int end = name_table_find(g->name_index, to);
     if (start == -1 || end == -1) return -1;
+    const QueryCacheEntry* hit = query_cache_find(g, CACHED_DISTANCE, start, end);
+    if (hit) return hit->value;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    if (scratch_begin(&g->scratch, g->size) != 0) return -1;
+    int d = bidirectional_distance(csr, &g->scratch, start, end);
+    query_cache_put(g, CACHED_DISTANCE, start, end, d, NULL);
+    return d;
+}
 
-    int* dist = malloc(sizeof(int) * g->size);
-    int* visited = calloc(g->size, sizeof(int));
-    if (!dist || !visited) {
-        free(dist);
-        free(visited);
-        return -1;
-    }
 
-    for (int i = 0; i < g->size; i++) dist[i] = INT_MAX;
-    dist[start] = 0;
+// --- Пакетные запросы --- //
+// Контекст пакета: неизменяемый снимок графа и буферы исполнителей
+typedef struct {
+    const Graph* g;
+    const CsrView* csr;
+    SearchScratch* scratch;
+    const BatchQuery* queries;
+    BatchResult* results;
+} BatchContext;
 
-    for (;;) {
-        int u = -1;
-        int min_dist = INT_MAX;
-        for (int i = 0; i < g->size; i++) {
-            if (!visited[i] && dist[i] < min_dist) {
-                min_dist = dist[i];
-                u = i;
-            }
-        }
-        if (u == -1 || u == end)
-            break;
+static void run_batch_query(void* arg, int worker, long index) {
+    STAT_SCOPE(OP_BATCH_QUERY);
+    BatchContext* ctx = arg;
+    const BatchQuery* q = &ctx->queries[index];
+    BatchResult* r = &ctx->results[index];
+    SearchScratch* sc = &ctx->scratch[worker];
+    // поиск имён только читает таблицу, поэтому безопасен из нескольких потоков
+    NameHashTable* names = ctx->g->name_index;
+    r->status = 0;
+    r->distance = -1;
+    r->shares = NULL;
+    r->share_count = 0;
+    int start = name_table_find(names, q->from);
+    if (start < 0) { r->status = -1; return; }
+    if (q->kind == QUERY_DISTANCE) {
+        int end = name_table_find(names, q->to);
+        if (end < 0) { r->status = -1; return; }
+        if (scratch_begin(sc, ctx->g->size) != 0) { r->status = -2; return; }
+        r->distance = bidirectional_distance(ctx->csr, sc, start, end);
+    } else {
+        int count = inheritance_shares(ctx->g, ctx->csr, sc, start, q->amount, &r->shares);
+        if (count < 0) r->status = -2;
+        else r->share_count = count;
+    }
+}
 
-        visited[u] = 1;
-        Edge* e = g->vertices[u].edges;
-        while (e) {
-            int v = e->to;
-            if (!visited[v] && dist[u] + 1 < dist[v]) {
-                dist[v] = dist[u] + 1;
-            }
-            e = e->next;
-        }
+// Пул для пакета: при threads == 0 подходит любой уже созданный пул графа. Пул обхода
+// по уровням не пересоздаётся — пакетам с другим числом потоков нужен свой.
+static ThreadPool* batch_pool(Graph* g, int threads) {
+    if (threads <= 0) {
+        if (g->batch_pool) return g->batch_pool;
+        if (g->pool) return g->pool;
+        threads = thread_pool_default_size();
+    }
+    if (g->pool && thread_pool_size(g->pool) == threads) return g->pool;
+    if (g->batch_pool && thread_pool_size(g->batch_pool) != threads) {
+        thread_pool_free(g->batch_pool);
+        g->batch_pool = NULL;
     }
+    if (!g->batch_pool) g->batch_pool = thread_pool_create(threads);
+    return g->batch_pool;
+}
+
+int run_batch_queries(Graph* g, const BatchQuery* queries, BatchResult* results, long count, int threads) {
+    if (!g || (count > 0 && (!queries || !results))) return -1;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    ThreadPool* pool = batch_pool(g, threads);
+    if (!pool) return -1;
+    int workers = thread_pool_size(pool);
+    if (g->worker_scratch_count < workers) {
+        SearchScratch* tmp = realloc(g->worker_scratch, sizeof(SearchScratch) * workers);
+        if (!tmp) return -1;
+        memset(tmp + g->worker_scratch_count, 0,
+               sizeof(SearchScratch) * (workers - g->worker_scratch_count));
+        g->worker_scratch = tmp;
+        g->worker_scratch_count = workers;
+    }
+    BatchContext ctx = { g, csr, g->worker_scratch, queries, results };
+    thread_pool_run(pool, count, run_batch_query, &ctx);
+    return 0;
+}
 
-    int result = (dist[end] == INT_MAX) ? -1 : dist[end];
-    free(dist);
-    free(visited);
-    return result;
+void free_batch_results(BatchResult* results, long count) {
+    if (!results) return;
+    for (long i = 0; i < count; i++) {
+        free(results[i].shares);
+        results[i].shares = NULL;
+        results[i].share_count = 0;
+    }
 }
 
 
 
 void print_graph(Graph* g) {
+    STAT_SCOPE(OP_PRINT_GRAPH);
     if (!g) return;
-    printf("Граф (кол-во вертексов: %d):\n", g->size);
+    const CsrView* csr = graph_view(g);
+    if (!csr) return;
+    printf("Граф (кол-во вертексов: %d):\n", g->live_count);
+    TextWriter w;
+    if (text_writer_open(&w, stdout, PRINT_BUFFER_SIZE) != 0) return;
     for (int i = 0; i < g->size; i++) {
-        printf("  %s (%s, %d-%d)\n",
-               g->vertices[i].person.name,
-               g->vertices[i].person.gender == MALE ? "male" : "female",
-               g->vertices[i].person.birth_year,
-               g->vertices[i].person.death_year);
-        Edge* e = g->vertices[i].edges;
-        while (e) {
-            if (e->relation == PARENT) {
-                // Только родители (PARENT) выводятся циан
-                printf("%s    -> %s%s\n",
-                       CYAN,
-                       g->vertices[e->to].person.name,
-                       RESET);
-            } else {
-                // Остальные отношения без цвета
-                printf("    -> %s\n",
-                       g->vertices[e->to].person.name);
-            }
-            e = e->next;
+        if (g->vertices[i].removed) continue;
+        STAT_EDGES(csr->offsets[i + 1] - csr->offsets[i]);
+        text_put(&w, "  ", 2);
+        text_put_str(&w, g->vertices[i].name);
+        text_put_str(&w, g->people.gender[i] == MALE ? " (male, " : " (female, ");
+        text_put_int(&w, g->people.birth_year[i]);
+        text_put(&w, "-", 1);
+        text_put_int(&w, g->people.death_year[i]);
+        text_put(&w, ")\n", 2);
+        for (int k = csr->offsets[i]; k < csr->offsets[i + 1]; k++) {
+            // Только родители (PARENT) выводятся циан, остальные отношения без цвета
+            int parent = csr->relation[k] == PARENT;
+            if (parent) text_put_str(&w, CYAN);
+            text_put(&w, "    -> ", 7);
+            text_put_str(&w, g->vertices[csr->to[k]].name);
+            if (parent) text_put_str(&w, RESET);
+            text_put(&w, "\n", 1);
         }
     }
+    text_writer_close(&w);
 }
 
 
 
 // --- Экспорт в DOT --- //
+// Вывод копится в TextWriter; каждое имя пишется один раз — в метке вершины,
+// а рёбра ссылаются на числовые идентификаторы (индексы).
+
+// Имя в кавычках; кавычки и обратная косая черта экранируются
+static void dot_put_quoted(TextWriter* w, const char* s) {
+    text_put(w, "\"", 1);
+    const char* run = s;
+    for (; *s; s++) {
+        if (*s != '"' && *s != '\\') continue;
+        text_put(w, run, s - run);
+        text_put(w, "\\", 1);
+        run = s;
+    }
+    text_put(w, run, s - run);
+    text_put(w, "\"", 1);
+}
+
+// Объявление вершины с меткой-именем
+static void dot_put_vertex(TextWriter* w, const Graph* g, int v) {
+    text_put(w, "  ", 2);
+    text_put_int(w, v);
+    text_put(w, " [label=", 8);
+    dot_put_quoted(w, g->vertices[v].name);
+    text_put(w, "];\n", 3);
+}
+
+static void dot_put_edge(TextWriter* w, int from, int to) {
+    text_put(w, "  ", 2);
+    text_put_int(w, from);
+    text_put(w, " -> ", 4);
+    text_put_int(w, to);
+    text_put(w, ";\n", 2);
+}
+
+static int dot_writer_open(TextWriter* w, FILE* f) {
+    if (text_writer_open(w, f, DOT_BUFFER_SIZE) != 0) return -1;
+    text_put_str(w, "digraph G {\n");
+    return 0;
+}
+
+// Завершает запись; в режиме памяти буфер остаётся у w->buf (при ошибке освобождается)
+static int dot_writer_close(TextWriter* w) {
+    text_put_str(w, "}\n");
+    int rc = text_writer_flush(w);
+    if (w->f || rc != 0) {
+        free(w->buf);
+        w->buf = NULL;
+    }
+    return rc;
+}
+
+// Записывает весь граф в открытый писатель
+static void dot_write_all(const Graph* g, TextWriter* w) {
+    // граф константный, поэтому снимок используется только если он уже актуален
+    const CsrView* csr = g->csr.valid ? &g->csr : NULL;
+    for (int i = 0; i < g->size; i++) {
+        if (g->vertices[i].removed) continue;
+        dot_put_vertex(w, g, i);
+        if (csr) {
+            for (int k = csr->offsets[i]; k < csr->offsets[i + 1]; k++)
+                dot_put_edge(w, i, csr->to[k]);
+            continue;
+        }
+        for (Edge *e = g->vertices[i].edges; e; e = e->next)
+            dot_put_edge(w, i, e->to);
+    }
+}
+
+// Записывает окрестность center: всех, до кого не больше generations шагов
+// по рёбрам в любом направлении, и рёбра между ними
+static int dot_write_neighbourhood(Graph* g, TextWriter* w, int center, int generations) {
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    SearchScratch* sc = &g->scratch;
+    if (scratch_begin(sc, g->size) != 0) return -1;
+    int head = 0, tail = 0;
+    sc->mark_fwd[center] = sc->stamp;
+    sc->dist_fwd[center] = 0;
+    sc->queue_fwd[tail++] = center;
+    while (head < tail) {
+        int u = sc->queue_fwd[head++];
+        if (sc->dist_fwd[u] >= generations) continue;
+        for (int dir = 0; dir < 2; dir++) {
+            const int* offs = dir ? csr->in_offsets : csr->offsets;
+            const int* adj = dir ? csr->in_from : csr->to;
+            STAT_EDGES(offs[u + 1] - offs[u]);
+            for (int k = offs[u]; k < offs[u + 1]; k++) {
+                int v = adj[k];
+                if (sc->mark_fwd[v] == sc->stamp) continue;
+                sc->mark_fwd[v] = sc->stamp;
+                sc->dist_fwd[v] = sc->dist_fwd[u] + 1;
+                sc->queue_fwd[tail++] = v;
+            }
+        }
+    }
+    for (int i = 0; i < tail; i++) {
+        int u = sc->queue_fwd[i];
+        dot_put_vertex(w, g, u);
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++)
+            if (sc->mark_fwd[csr->to[k]] == sc->stamp) dot_put_edge(w, u, csr->to[k]);
+    }
+    return tail;
+}
+
 void export_dot(const Graph *g, const char *dot_path) {
+    STAT_SCOPE(OP_EXPORT_DOT);
     FILE *f = fopen(dot_path, "w");
     if (!f) return;
-    fprintf(f, "digraph G {\n");
-    for (int i = 0; i < g->size; i++) {
-        fprintf(f, "  \"%s\";\n", g->vertices[i].person.name);
-        for (Edge *e = g->vertices[i].edges; e; e = e->next) {
-            // Экспортируем с меткой отношения
-            fprintf(f,
-                    "  \"%s\" -> \"%s\";\n",
-                    g->vertices[i].person.name,
-                    g->vertices[e->to].person.name);
-        }
+    TextWriter w;
+    if (dot_writer_open(&w, f) == 0) {
+        dot_write_all(g, &w);
+        dot_writer_close(&w);
     }
-    fprintf(f, "}\n");
     fclose(f);
 }
 
+int export_dot_neighbourhood(Graph* g, const char* dot_path, const char* name, int generations) {
+    STAT_SCOPE(OP_EXPORT_DOT);
+    if (!g || !dot_path || !name || generations < 0) return -1;
+    int center = name_table_find(g->name_index, name);
+    if (center < 0) return -1;
+    FILE* f = fopen(dot_path, "w");
+    if (!f) return -1;
+    TextWriter w;
+    int count = -1;
+    if (dot_writer_open(&w, f) == 0) {
+        count = dot_write_neighbourhood(g, &w, center, generations);
+        if (dot_writer_close(&w) != 0) count = -1;
+    }
+    if (fclose(f) != 0) count = -1;
+    return count;
+}
+
+char* export_dot_buffer(Graph* g, const char* name, int generations, size_t* size) {
+    STAT_SCOPE(OP_EXPORT_DOT);
+    if (!g || (name && generations < 0)) return NULL;
+    int center = -1;
+    if (name && (center = name_table_find(g->name_index, name)) < 0) return NULL;
+    TextWriter w;
+    if (dot_writer_open(&w, NULL) != 0) return NULL;
+    if (center >= 0 && dot_write_neighbourhood(g, &w, center, generations) < 0) w.error = 1;
+    if (center < 0) dot_write_all(g, &w);
+    if (dot_writer_close(&w) != 0) return NULL;
+    if (size) *size = w.used;
+    return w.buf;
+}
+
 
 // --- Вызов утилиты dot для рендеринга в .svg ---
 void render_svg(const char *dot_path, const char *svg_path) {
@@ -468,4 +3564,345 @@ void render_svg(const char *dot_path, const char *svg_path) {
     snprintf(cmd, sizeof(cmd),
         "dot -Tsvg \"%s\" -o \"%s\"", dot_path, svg_path);
     system(cmd);
-}
\ No newline at end of file
+}
+
+
+// ----------- Бинарный снимок -------------- //
+// Заголовок файла; все секции выровнены на 8 байт, смещения — от начала файла.
+// Столбцы людей, CSR-массивы и ячейки таблицы имён лежат в том же виде, что и в памяти,
+// поэтому load_snapshot использует их прямо из отображённого файла.
+typedef struct {
+    char magic[8];            // SNAPSHOT_MAGIC
+    uint32_t version;         // SNAPSHOT_VERSION
+    uint32_t byte_order;      // SNAPSHOT_BYTE_ORDER в порядке байт записавшей машины
+    uint32_t hash_bits;       // Разрядность хэшей в таблице имён
+    uint32_t reserved;
+    int64_t vertex_count;     // Количество слотов вершин (включая удалённые)
+    int64_t live_count;       // Количество людей
+    int64_t edge_count;       // Количество рёбер
+    int64_t table_capacity;   // Размер таблицы имён
+    int64_t table_count;      // Занятые ячейки таблицы имён
+    uint64_t names_size;      // Размер пула строк
+    uint64_t off_name_at;     // uint64[vertex_count]: смещение имени в пуле или SNAPSHOT_NO_NAME
+    uint64_t off_birth;       // int32[vertex_count]: годы рождения (у удалённых — REMOVED_BIRTH_YEAR)
+    uint64_t off_death;       // int32[vertex_count]: годы смерти
+    uint64_t off_gender;      // uint8[vertex_count]: пол
+    uint64_t off_names;       // Пул строк, завершённых нулём
+    uint64_t off_offsets;     // int32[vertex_count + 1]
+    uint64_t off_to;          // int32[edge_count]
+    uint64_t off_relation;    // uint8[edge_count]
+    uint64_t off_in_offsets;  // int32[vertex_count + 1]
+    uint64_t off_in_from;     // int32[edge_count]
+    uint64_t off_in_relation; // uint8[edge_count]
+    uint64_t off_table;       // SnapshotSlot[table_capacity]
+    uint64_t file_size;       // Полный размер файла
+} SnapshotHeader;
+
+// Ячейка таблицы имён в снимке; при 64-битных хэшах совпадает с NameHashSlot
+typedef struct {
+    uint64_t hash;
+    int32_t index;        // Индекс вершины; -1 — ячейка пуста
+    int32_t reserved;
+} SnapshotSlot;
+
+// Можно ли использовать ячейки снимка как NameHashSlot без преобразования
+static int snapshot_slots_native(const SnapshotHeader* h) {
+    return h->hash_bits == sizeof(unsigned long) * 8
+        && sizeof(unsigned long) == sizeof(uint64_t)
+        && sizeof(NameHashSlot) == sizeof(SnapshotSlot)
+        && offsetof(NameHashSlot, index) == offsetof(SnapshotSlot, index);
+}
+
+// Дополняет уже записанную секцию размера size нулями до кратного 8 размера
+static int write_padding(FILE* f, size_t size, uint64_t* pos) {
+    static const char zeros[8] = {0};
+    size_t pad = (8 - size % 8) % 8;
+    if (pad > 0 && fwrite(zeros, 1, pad, f) != pad) return -1;
+    *pos += size + pad;
+    return 0;
+}
+
+// Пишет секцию вместе с выравниванием
+static int write_section(FILE* f, const void* data, size_t size, uint64_t* pos) {
+    if (size > 0 && fwrite(data, 1, size, f) != size) return -1;
+    return write_padding(f, size, pos);
+}
+
+int save_snapshot(Graph* g, const char* path) {
+    STAT_SCOPE(OP_SAVE_SNAPSHOT);
+    if (!g || !path) return -1;
+    const CsrView* csr = graph_view(g);
+    if (!csr) return -1;
+    int n = g->size;
+    int m = csr->edge_count;
+    NameHashTable* ht = g->name_index;
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.byte_order = SNAPSHOT_BYTE_ORDER;
+    h.hash_bits = (uint32_t)(sizeof(unsigned long) * 8);
+    h.vertex_count = n;
+    h.live_count = g->live_count;
+    h.edge_count = m;
+    h.table_capacity = ht->capacity;
+    h.table_count = ht->count;
+
+    // смещения имён в пуле и ячейки таблицы
+    uint64_t* name_at = malloc(sizeof(uint64_t) * (n > 0 ? n : 1));
+    SnapshotSlot* slots = calloc(ht->capacity, sizeof(SnapshotSlot));
+    if (!name_at || !slots) { free(name_at); free(slots); return -1; }
+    uint64_t names_size = 0;
+    for (int i = 0; i < n; i++) {
+        name_at[i] = SNAPSHOT_NO_NAME;
+        if (g->vertices[i].removed) continue;
+        name_at[i] = names_size;
+        names_size += strlen(g->vertices[i].name) + 1;
+    }
+    for (int i = 0; i < ht->capacity; i++) {
+        slots[i].hash = ht->slots[i].hash;
+        slots[i].index = ht->slots[i].index >= 0 ? ht->slots[i].index : -1;
+    }
+    h.names_size = names_size;
+
+    // раскладка секций
+    uint64_t pos = (sizeof(h) + 7) & ~(uint64_t)7;
+    #define SNAPSHOT_PLACE(field, bytes) do { h.field = pos; pos += ((uint64_t)(bytes) + 7) & ~(uint64_t)7; } while (0)
+    SNAPSHOT_PLACE(off_name_at, sizeof(uint64_t) * (size_t)n);
+    SNAPSHOT_PLACE(off_birth, sizeof(int) * (size_t)n);
+    SNAPSHOT_PLACE(off_death, sizeof(int) * (size_t)n);
+    SNAPSHOT_PLACE(off_gender, (size_t)n);
+    SNAPSHOT_PLACE(off_names, names_size);
+    SNAPSHOT_PLACE(off_offsets, sizeof(int) * (size_t)(n + 1));
+    SNAPSHOT_PLACE(off_to, sizeof(int) * (size_t)m);
+    SNAPSHOT_PLACE(off_relation, (size_t)m);
+    SNAPSHOT_PLACE(off_in_offsets, sizeof(int) * (size_t)(n + 1));
+    SNAPSHOT_PLACE(off_in_from, sizeof(int) * (size_t)m);
+    SNAPSHOT_PLACE(off_in_relation, (size_t)m);
+    SNAPSHOT_PLACE(off_table, sizeof(SnapshotSlot) * (size_t)ht->capacity);
+    #undef SNAPSHOT_PLACE
+    h.file_size = pos;
+
+    // пишем во временный файл и переименовываем: путь может совпадать со снимком,
+    // из которого загружен сам граф (он отображён в память и не должен обрезаться)
+    char* tmp_path = malloc(strlen(path) + 5);
+    if (!tmp_path) { free(name_at); free(slots); return -1; }
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "wb");
+    if (!f) { free(tmp_path); free(name_at); free(slots); return -1; }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    pos = 0;
+    int rc = write_section(f, &h, sizeof(h), &pos);
+    if (rc == 0) rc = write_section(f, name_at, sizeof(uint64_t) * (size_t)n, &pos);
+    if (rc == 0) rc = write_section(f, g->people.birth_year, sizeof(int) * (size_t)n, &pos);
+    if (rc == 0) rc = write_section(f, g->people.death_year, sizeof(int) * (size_t)n, &pos);
+    if (rc == 0) rc = write_section(f, g->people.gender, (size_t)n, &pos);
+    if (rc == 0) {
+        for (int i = 0; i < n && rc == 0; i++) {
+            if (g->vertices[i].removed) continue;
+            const char* name = g->vertices[i].name;
+            size_t len = strlen(name) + 1;
+            if (fwrite(name, 1, len, f) != len) rc = -1;
+        }
+        if (rc == 0) rc = write_padding(f, names_size, &pos);
+    }
+    if (rc == 0) rc = write_section(f, csr->offsets, sizeof(int) * (size_t)(n + 1), &pos);
+    if (rc == 0) rc = write_section(f, csr->to, sizeof(int) * (size_t)m, &pos);
+    if (rc == 0) rc = write_section(f, csr->relation, (size_t)m, &pos);
+    if (rc == 0) rc = write_section(f, csr->in_offsets, sizeof(int) * (size_t)(n + 1), &pos);
+    if (rc == 0) rc = write_section(f, csr->in_from, sizeof(int) * (size_t)m, &pos);
+    if (rc == 0) rc = write_section(f, csr->in_relation, (size_t)m, &pos);
+    if (rc == 0) rc = write_section(f, slots, sizeof(SnapshotSlot) * (size_t)ht->capacity, &pos);
+    if (fclose(f) != 0) rc = -1;
+#ifdef _WIN32
+    if (rc == 0) remove(path); // rename в Windows не заменяет существующий файл
+#endif
+    if (rc == 0 && rename(tmp_path, path) != 0) rc = -1;
+    if (rc != 0) remove(tmp_path);
+    free(tmp_path);
+    free(name_at);
+    free(slots);
+    return rc;
+}
+
+// Проверяет, что секция [off, off + size) лежит внутри файла
+static int section_ok(const MappedFile* mf, uint64_t off, uint64_t size) {
+    return off % 8 == 0 && off <= mf->size && size <= mf->size - off;
+}
+
+// Указатель на секцию отображённого файла (страницы копируются при первой записи)
+static void* section_at(const MappedFile* mf, uint64_t off) {
+    return (void*)(mf->data + off);
+}
+
+// Подключает CSR-массивы файла и проверяет, что все индексы рёбер в границах
+static int snapshot_attach_csr(Graph* g, const MappedFile* mf, const SnapshotHeader* h) {
+    CsrView* csr = &g->csr;
+    int n = (int)h->vertex_count;
+    int m = (int)h->edge_count;
+    csr->offsets = section_at(mf, h->off_offsets);
+    csr->to = section_at(mf, h->off_to);
+    csr->relation = section_at(mf, h->off_relation);
+    csr->in_offsets = section_at(mf, h->off_in_offsets);
+    csr->in_from = section_at(mf, h->off_in_from);
+    csr->in_relation = section_at(mf, h->off_in_relation);
+    csr->mapped = 1;
+    csr->vertex_count = csr->vertex_capacity = n;
+    csr->edge_count = csr->edge_capacity = m;
+    if (csr->offsets[0] != 0 || csr->offsets[n] != m || csr->in_offsets[0] != 0 || csr->in_offsets[n] != m)
+        return -1;
+    for (int i = 0; i < n; i++)
+        if (csr->offsets[i] > csr->offsets[i + 1] || csr->in_offsets[i] > csr->in_offsets[i + 1]) return -1;
+    for (int k = 0; k < m; k++)
+        if ((unsigned)csr->to[k] >= (unsigned)n || (unsigned)csr->in_from[k] >= (unsigned)n) return -1;
+    return 0;
+}
+
+// Заполняет вершины по смещениям имён и подключает столбцы людей.
+// @return Количество живых людей или -1, если записи противоречивы.
+static int64_t snapshot_attach_people(Graph* g, const MappedFile* mf, const SnapshotHeader* h) {
+    int n = (int)h->vertex_count;
+    const uint64_t* name_at = section_at(mf, h->off_name_at);
+    const char* pool = mf->data + h->off_names;
+    PersonColumns* c = &g->people;
+    columns_free(c);
+    c->birth_year = section_at(mf, h->off_birth);
+    c->death_year = section_at(mf, h->off_death);
+    c->gender = section_at(mf, h->off_gender);
+    c->capacity = n;
+    c->mapped = 1;
+    int64_t live = 0;
+    for (int i = 0; i < n; i++) {
+        Vertex* v = &g->vertices[i];
+        v->edges = v->in_edges = NULL;
+        v->removed = name_at[i] == SNAPSHOT_NO_NAME;
+        // удалённые слоты узнаются по году рождения в столбце, поэтому признаки должны совпадать
+        if (v->removed != (c->birth_year[i] == REMOVED_BIRTH_YEAR) || c->gender[i] > FEMALE) return -1;
+        if (v->removed) {
+            v->name = (char*)"";
+            if (g->free_count >= g->free_capacity) {
+                int cap = g->free_capacity ? g->free_capacity * 2 : INITIAL_CAPACITY;
+                int* tmp = realloc(g->free_slots, sizeof(int) * cap);
+                if (!tmp) return -1;
+                g->free_slots = tmp;
+                g->free_capacity = cap;
+            }
+            g->free_slots[g->free_count++] = i;
+            continue;
+        }
+        if (name_at[i] >= h->names_size) return -1;
+        v->name = (char*)pool + name_at[i];
+        live++;
+    }
+    return live;
+}
+
+// Подключает таблицу имён файла. Каждая занятая ячейка должна ссылаться на живого
+// человека, ровно одна на человека, и хотя бы одна ячейка должна остаться пустой
+// (иначе пробы не кончатся).
+static int snapshot_attach_names(Graph* g, const MappedFile* mf, const SnapshotHeader* h) {
+    int n = (int)h->vertex_count;
+    if (h->table_count != g->live_count || h->table_count >= h->table_capacity) return -1;
+    NameHashSlot* slots = section_at(mf, h->off_table);
+    unsigned char* seen = calloc(n > 0 ? n : 1, 1);
+    if (!seen) return -1;
+    int64_t used = 0;
+    int ok = 1;
+    for (int64_t i = 0; ok && i < h->table_capacity; i++) {
+        int idx = slots[i].index;
+        if (idx == -1) continue;
+        ok = idx >= 0 && idx < n && !g->vertices[idx].removed && !seen[idx];
+        if (ok) seen[idx] = 1;
+        used++;
+    }
+    free(seen);
+    if (!ok || used != h->table_count) return -1;
+    NameHashTable* ht = g->name_index;
+    if (!ht->mapped) free(ht->slots);
+    ht->slots = slots;
+    ht->capacity = (int)h->table_capacity;
+    ht->count = (int)h->table_count;
+    ht->mapped = 1;
+    return 0;
+}
+
+Graph* load_snapshot(const char* path) {
+    STAT_SCOPE(OP_LOAD_SNAPSHOT);
+    if (!path) return NULL;
+    MappedFile mf;
+    if (map_file_private(path, &mf) != 0) return NULL;
+    SnapshotHeader h;
+    if (mf.size < sizeof(h)) { unmap_file(&mf); return NULL; }
+    memcpy(&h, mf.data, sizeof(h));
+    uint64_t n = (uint64_t)h.vertex_count;
+    uint64_t m = (uint64_t)h.edge_count;
+    int ok = memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) == 0
+        && h.version == SNAPSHOT_VERSION
+        && h.byte_order == SNAPSHOT_BYTE_ORDER
+        && h.file_size == mf.size
+        && h.vertex_count >= 0 && h.vertex_count < INT_MAX
+        && h.edge_count >= 0 && h.edge_count < INT_MAX
+        && h.live_count >= 0 && h.live_count <= h.vertex_count
+        && h.table_capacity > 0 && (h.table_capacity & (h.table_capacity - 1)) == 0
+        && h.table_capacity < INT_MAX
+        && h.table_count >= 0 && h.table_count <= h.table_capacity
+        && section_ok(&mf, h.off_name_at, sizeof(uint64_t) * n)
+        && section_ok(&mf, h.off_birth, sizeof(int) * n)
+        && section_ok(&mf, h.off_death, sizeof(int) * n)
+        && section_ok(&mf, h.off_gender, n)
+        && section_ok(&mf, h.off_names, h.names_size)
+        && section_ok(&mf, h.off_offsets, sizeof(int) * (n + 1))
+        && section_ok(&mf, h.off_to, sizeof(int) * m)
+        && section_ok(&mf, h.off_relation, m)
+        && section_ok(&mf, h.off_in_offsets, sizeof(int) * (n + 1))
+        && section_ok(&mf, h.off_in_from, sizeof(int) * m)
+        && section_ok(&mf, h.off_in_relation, m)
+        && section_ok(&mf, h.off_table, sizeof(SnapshotSlot) * (uint64_t)h.table_capacity)
+        && (h.names_size == 0 || mf.data[h.off_names + h.names_size - 1] == '\0')
+        && utf8_validate(mf.data + h.off_names, h.names_size, NULL, 0) == 0;
+    Graph* g = ok ? create_graph() : NULL;
+    if (!g) {
+        unmap_file(&mf);
+        return NULL;
+    }
+
+    // массив вершин — единственное, что строится заново: в нём указатели на имена
+    if (n > 0) {
+        Vertex* vertices = malloc(sizeof(Vertex) * n);
+        ok = vertices != NULL;
+        if (ok) {
+            free(g->vertices);
+            g->vertices = vertices;
+            g->capacity = (int)n;
+        }
+    }
+    int64_t live = ok && n > 0 ? snapshot_attach_people(g, &mf, &h) : 0;
+    // размеры буферов индексов берутся из live_count, поэтому заголовку не верим
+    ok = ok && live == h.live_count;
+    g->size = (int)n;
+    g->live_count = (int)live;
+    ok = ok && snapshot_attach_csr(g, &mf, &h) == 0;
+    g->edge_count = (int)m;
+
+    // таблица имён используется как есть, если ячейки совпадают с NameHashSlot
+    if (ok && snapshot_slots_native(&h)) {
+        ok = snapshot_attach_names(g, &mf, &h) == 0;
+    } else if (ok) {
+        NameHashTable* ht = g->name_index;
+        ok = name_table_reserve(ht, g->live_count) == 0;
+        for (uint64_t i = 0; ok && i < n; i++)
+            if (!g->vertices[i].removed)
+                ok = name_table_insert(ht, g->vertices[i].name, (int)i) == 0;
+    }
+
+    if (!ok) {
+        free_graph(g);
+        unmap_file(&mf);
+        return NULL;
+    }
+    g->csr.valid = 1;
+    g->edges_pending = m > 0;
+    g->snapshot = mf;
+    return g;
+}
@@ -1,6 +1,12 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mmfile.h"
+#include "threadpool.h"
+
 // Пол человека
 typedef enum {
     MALE,   // Мужской
@@ -21,38 +27,384 @@ typedef struct {
     int death_year;     // Год смерти; если < 0, человек считается живым
 } Person;
 
-// Структура ребра (связи) между вершинами графа
+// Структура ребра (связи) между вершинами графа.
+// Каждое ребро одновременно входит в список исходящих рёбер вершины from
+// и в список входящих рёбер вершины to.
 typedef struct Edge {
+    int from;                   // Индекс вершины, из которой выходит ребро
     int to;                     // Индекс вершины, на которую указывает ребро
     RelationType relation;     // Тип отношения (PARENT или CHILD)
-    struct Edge* next;         // Следующее ребро в списке (связный список)
+    struct Edge* next;         // Следующее ребро в списке исходящих (связный список)
+    struct Edge* next_in;      // Следующее ребро в списке входящих
 } Edge;
 
-// Структура вершины графа: содержит данные человека и список его связей
+// Структура вершины графа: имя человека и списки его связей.
+// Пол и годы жизни хранятся по столбцам в Graph.people (см. get_person).
 typedef struct {
-    Person person;     // Сам человек
+    char* name;        // Имя человека (уникальное в пределах графа)
     Edge* edges;       // Список исходящих рёбер (отношений с другими людьми)
+    Edge* in_edges;    // Список входящих рёбер (кто ссылается на этого человека)
+    int removed;       // 1, если человек удалён и слот ожидает повторного использования
 } Vertex;
 
-// Узел хэш-таблицы: связывает имя с индексом вершины
-typedef struct NameHashNode {
-    char* name;                  // Имя человека (ключ)
-    int index;                   // Индекс в массиве вершин
-    struct NameHashNode* next;  // Следующий элемент в цепочке (при коллизии)
-} NameHashNode;
+// Ячейка хэш-таблицы: связывает имя с индексом вершины. Ключ — имя этой вершины,
+// поэтому в ячейке нет указателей и таблицу можно читать прямо из файла снимка.
+typedef struct {
+    unsigned long hash;  // Полный хэш имени (сравнивается до strcmp)
+    int index;           // Индекс в массиве вершин; -1 — ячейка пуста
+} NameHashSlot;
 
-// Хэш-таблица для быстрого поиска индекса по имени
+// Хэш-таблица с открытой адресацией (линейное пробирование) для поиска индекса по имени.
+// Размер — степень двойки, таблица растёт вдвое при превышении коэффициента заполнения.
 typedef struct {
-    NameHashNode** table;  // Массив указателей на цепочки
-    int capacity;          // Размер таблицы (количество ячеек)
+    NameHashSlot* slots;      // Массив ячеек
+    int capacity;             // Размер таблицы (количество ячеек)
+    int count;                // Количество занятых ячеек
+    Vertex* const* vertices;  // Массив вершин графа (Graph.vertices), имена которых — ключи
+    int mapped;               // 1 — ячейки лежат в отображённом файле снимка (не освобождаются)
 } NameHashTable;
 
+// Блок арены: заголовок, за которым следуют данные
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;  // Предыдущий выделенный блок
+    size_t used;              // Сколько байт данных уже занято
+    size_t capacity;          // Размер области данных блока
+} ArenaBlock;
+
+// Арена (bump-аллокатор): память выдаётся последовательно из больших блоков
+// и возвращается системе только целиком вместе с графом. Рёбра и имена, освобождённые
+// раньше, складываются в списки свободных (Graph.free_edges, Graph.names) и
+// переиспользуются, поэтому арена не растёт при чередовании добавлений и удалений.
+typedef struct {
+    ArenaBlock* head;  // Текущий блок (из него идёт выделение)
+} Arena;
+
+#define NAME_CLASS_COUNT 48 // классы размеров блоков имён (см. NamePool)
+
+// Освобождённые копии имён. Блок имени округляется до класса размеров: до 32 шагов
+// выравнивания арены — с шагом выравнивания, дальше — до степени двойки; имена
+// длиннее самого большого класса остаются в арене до free_graph.
+typedef struct {
+    void* free[NAME_CLASS_COUNT]; // Списки свободных блоков по классам (ссылка — в начале блока)
+} NamePool;
+
+// Компактный снимок рёбер в формате CSR (compressed sparse row).
+// Рёбра вершины i лежат подряд в to/relation на позициях offsets[i]..offsets[i+1]-1,
+// в том же порядке, что и в связном списке Vertex.edges.
+// Обратные рёбра (входящие в i) лежат в in_from на позициях in_offsets[i]..in_offsets[i+1]-1.
+typedef struct {
+    int* offsets;             // Начала списков рёбер (vertex_count + 1 элементов)
+    int* to;                  // Индексы целевых вершин всех рёбер подряд
+    unsigned char* relation;  // Типы связей (RelationType) всех рёбер подряд
+    int* in_offsets;          // Начала списков входящих рёбер (vertex_count + 1 элементов)
+    int* in_from;             // Индексы исходных вершин входящих рёбер подряд
+    unsigned char* in_relation; // Типы связей входящих рёбер подряд
+    int vertex_count;         // Количество вершин, для которых построен снимок
+    int edge_count;           // Количество рёбер в снимке
+    int vertex_capacity;      // Вместимость массива offsets (без учёта завершающего элемента)
+    int edge_capacity;        // Вместимость массивов to и relation
+    int valid;                // 1, если снимок соответствует текущему состоянию графа
+    int mapped;               // 1 — массивы лежат в отображённом файле снимка (не освобождаются)
+} CsrView;
+
+// Рабочие буферы поиска, переиспользуемые между запросами.
+// Вершина считается посещённой в текущем запросе, если её метка равна stamp,
+// поэтому перед новым запросом достаточно увеличить stamp вместо очистки массивов.
+typedef struct {
+    unsigned int* mark_fwd;  // Метки посещения прямым фронтом
+    unsigned int* mark_bwd;  // Метки посещения обратным фронтом
+    int* dist_fwd;           // Расстояния от начальной вершины
+    int* dist_bwd;           // Расстояния до конечной вершины
+    int* queue_fwd;          // Очередь прямого фронта
+    int* queue_bwd;          // Очередь обратного фронта
+    int capacity;            // На сколько вершин рассчитаны буферы
+    unsigned int stamp;      // Метка текущего запроса
+} SearchScratch;
+
+// Буферы обхода по уровням, переиспользуемые между запросами.
+// Уровень d (поколение, 0 — исходная вершина) занимает order[level_start[d]..level_start[d+1]-1].
+typedef struct {
+    int* order;               // Найденные вершины по уровням, начиная с исходной
+    int* level_start;         // Начала уровней в order (levels + 1 элементов)
+    int levels;               // Количество уровней, включая уровень исходной вершины
+    int* claim;               // Ранг ребра, первым дошедшего до вершины на уровне (INT_MAX — ни одного)
+    int* rank;                // Ранг первого ребра каждой вершины уровня
+    int* chunk_count;         // Сколько вершин нашла каждая задача уровня (затем — куда их писать)
+    uint64_t* visited;        // Биты найденных вершин
+    uint64_t* in_frontier;    // Биты вершин текущего уровня (для раскрытия снизу вверх)
+    int capacity;             // На сколько вершин рассчитаны буферы
+    int threads;              // Исполнителей для широких уровней (0 или 1 — в вызывающем потоке)
+    int bottom_up;            // 1 — широкие уровни можно раскрывать снизу вверх
+} LevelTraversal;
+
+// Поколения потомков или предков (см. get_generations)
+typedef struct {
+    int* ids;          // Люди по поколениям
+    int count;         // Количество людей
+    int* level_start;  // Поколение d (с 1) — ids[level_start[d-1]..level_start[d]-1]
+    int generations;   // Количество поколений
+} GenerationLevels;
+
+// Человек, найденный обходом, и его поколение относительно начального
+typedef struct {
+    int person;  // Индекс человека
+    int depth;   // Поколение: 1 — дети (родители), 2 — внуки (деды) и т.д.
+} PersonDepth;
+
+// Посетитель обхода; ненулевой результат останавливает обход
+typedef int (*PersonVisitor)(void* ctx, int person, int depth);
+
+// Предок вершины вместе с расстоянием до него (в поколениях)
+typedef struct {
+    int ancestor;  // Индекс предка
+    int depth;     // Число поколений от вершины до предка (1 — родитель)
+} AncestorEntry;
+
+// Индекс родства: для каждой вершины — отсортированный по индексу список всех её предков.
+// Строится лениво в топологическом порядке (список вершины = объединение списков родителей)
+// и сбрасывается при любом изменении графа.
+typedef struct {
+    AncestorEntry* entries;  // Списки предков всех вершин подряд
+    long long* start;        // Начало списка вершины i в entries
+    int* count;              // Длина списка вершины i
+    long long entry_count;   // Общее число записей
+    int vertex_count;        // Количество вершин, для которых построен индекс
+    int valid;               // 1, если индекс соответствует текущему состоянию графа
+    int cyclic;              // 1, если связи PARENT содержат цикл (индекс не строится до изменения графа)
+} KinshipIndex;
+
+// Доля наследства одного наследника
+typedef struct {
+    int person;    // Индекс наследника в массиве вершин
+    double share;  // Сумма, причитающаяся наследнику
+} InheritanceShare;
+
+// Тип запроса в пакете
+typedef enum {
+    QUERY_DISTANCE,    // shortest_relation_path(from, to)
+    QUERY_INHERITANCE  // распределение наследства from на сумму amount
+} QueryKind;
+
+// Один запрос пакета
+typedef struct {
+    QueryKind kind;    // Тип запроса
+    const char* from;  // Начальный человек (для наследства — наследодатель)
+    const char* to;    // Конечный человек (только для QUERY_DISTANCE)
+    double amount;     // Сумма наследства (только для QUERY_INHERITANCE)
+} BatchQuery;
+
+// Результат одного запроса пакета
+typedef struct {
+    int status;                 // 0 — успех, -1 — человек не найден, -2 — ошибка памяти
+    int distance;               // QUERY_DISTANCE: длина пути или -1, если пути нет
+    InheritanceShare* shares;   // QUERY_INHERITANCE: доли по возрастанию индекса наследника
+    int share_count;            // Количество долей (0 — живых потомков нет)
+} BatchResult;
+
+// Способ, которым индекс достижимости отвечает на запросы
+typedef enum {
+    REACH_NONE,      // Индекс не построен — запросы выполняются обходом графа
+    REACH_BITSET,    // Полное транзитивное замыкание: битовая строка потомков на вершину
+    REACH_INTERVAL   // Интервальные метки по остовному лесу DFS + обход с отсечением
+} ReachMode;
+
+// Индекс достижимости по связям PARENT («является ли A потомком B»).
+// Если n² бит помещается в лимит памяти, хранится полное замыкание, иначе — интервальные метки.
+typedef struct {
+    uint64_t* bits;   // Строки замыкания: строка i — words слов, бит j = «j — потомок i»
+    int words;        // Количество 64-битных слов в строке
+    int* post;        // Номер вершины в обратном порядке обхода DFS
+    int* tree_low;    // Минимальный post в поддереве остовного леса
+    int* low;         // Минимальный post среди всех потомков
+    int vertex_count; // Количество вершин, для которых построен индекс
+    ReachMode mode;   // Текущий режим индекса
+    int enabled;      // 1, если индекс нужно поддерживать (см. graph_build_reachability)
+    int valid;        // 1, если индекс соответствует текущему состоянию графа
+    int cyclic;       // 1, если связи PARENT содержат цикл (индекс не строится до изменения графа)
+} ReachabilityIndex;
+
+// Результат поиска ближайшего общего предка двух людей
+typedef struct {
+    int ancestor;  // Индекс ближайшего общего предка (-1, если его нет)
+    int depth_a;   // Поколений от первого человека до предка (0 — это он сам)
+    int depth_b;   // Поколений от второго человека до предка
+} Kinship;
+
+// Сводка по потомкам человека (только рёбра PARENT)
+typedef struct {
+    long descendants;  // Количество потомков
+    long living;       // Из них живых
+    double weight;     // Сумма весов живых потомков 1 / 2^(d-1), d — поколений до потомка;
+                       // наследник в d поколениях получает amount / weight / 2^(d-1)
+} DescendantSummary;
+
+// Поддерживаемые на лету сводки по потомкам для каждой вершины.
+// Изменения листьев (новый ребёнок без детей, удаление бездетного, смена года смерти)
+// применяются к сводкам предков точными приращениями за один обратный обход;
+// остальные изменения помечают предков устаревшими, и их сводка пересчитывается
+// при следующем чтении.
+typedef struct {
+    int enabled;               // 1, если сводки поддерживаются
+    int capacity;              // Размер массивов
+    DescendantSummary* items;  // Сводка для каждой вершины
+    unsigned char* fresh;      // 1 — сводка актуальна, 0 — пересчитать при чтении
+} DescendantAggregates;
+
+// Пол и годы жизни людей по столбцам: данные вершины i — элемент i каждого массива.
+// Выборки по годам (count_alive, filter_by_birth_range, alive_in_year) читают только
+// нужные столбцы подряд, а не записи вершин целиком.
+typedef struct {
+    int* birth_year;        // Годы рождения (у удалённых слотов — INT_MIN)
+    int* death_year;        // Годы смерти; < 0 — человек жив
+    unsigned char* gender;  // Пол (Gender)
+    int capacity;           // Вместимость массивов (равна Graph.capacity)
+    int mapped;             // 1 — массивы лежат в отображённом файле снимка (при росте копируются)
+} PersonColumns;
+
+// Изменения, ещё не попавшие в индекс, который перестраивается целиком: люди,
+// добавленные или изменённые после построения, проверяются запросами отдельно,
+// а их прежние записи в индексе пропускаются
+typedef struct {
+    int* where;          // Для каждого слота: DELTA_BUILT, DELTA_NONE или позиция в items
+    int where_capacity;  // Размер массива where
+    int* items;          // Люди, ещё не попавшие в индекс
+    int count;           // Количество людей в items
+    int capacity;        // Вместимость items
+    int stale;           // Записей индекса, ставших недействительными
+} IndexDelta;
+
+// Отрезок жизни человека в индексе: [birth, death]; у живых death = INT_MAX
+typedef struct {
+    int person;  // Индекс вершины
+    int birth;   // Год рождения
+    int death;   // Год смерти (INT_MAX — жив)
+} LifespanEntry;
+
+// Узел центрированного дерева отрезков жизни. В узле лежат отрезки, содержащие
+// center; целиком левее center — в левом поддереве, правее — в правом.
+typedef struct {
+    int center;  // Год, через который проходят все отрезки узла
+    int left;    // Левое поддерево (-1 — нет)
+    int right;   // Правое поддерево (-1 — нет)
+    int first;   // Начало отрезков узла в by_birth и by_death
+    int count;   // Количество отрезков узла
+} LifespanNode;
+
+// Индекс отрезков жизни для запросов «кто жил в году Y» и «чья жизнь пересекает
+// годы A..B» за O(log n + k). Дерево строится целиком; изменения после построения
+// копятся в delta, и когда их становится много, дерево перестраивается при
+// следующем запросе.
+typedef struct {
+    LifespanNode* nodes;     // Узлы дерева (корень — nodes[0])
+    int node_count;          // Количество узлов
+    LifespanEntry* by_birth; // Отрезки узлов по возрастанию года рождения
+    LifespanEntry* by_death; // Те же отрезки по убыванию года смерти
+    int tree_count;          // Отрезков в дереве
+    IndexDelta delta;        // Люди, изменённые после построения дерева
+    int enabled;             // 1, если индекс поддерживается (включается первым запросом)
+} LifespanIndex;
+
+// Запись индекса имён: свёрнутый ключ внутри NameSearchIndex.folded
+typedef struct {
+    const char* key;  // Имя целиком или его часть, начиная с одного из слов (за ним — '\0')
+    int len;          // Длина ключа в байтах
+    int person;       // Индекс вершины
+} NameEntry;
+
+// Индекс имён для поиска по началу имени, по фамилии и с опечатками.
+// Ключи сравниваются без учёта регистра латиницы и кириллицы (ё не отличается от е):
+// при построении имена сворачиваются в folded, и ключи упорядочены memcmp.
+// Как и индекс отрезков жизни, строится целиком при первом запросе, а изменения
+// после построения копятся в delta.
+typedef struct {
+    char* folded;      // Свёрнутые имена подряд, каждое с '\0' в конце
+    NameEntry* names;  // Имена целиком, по алфавиту
+    int name_count;    // Количество записей в names
+    NameEntry* words;  // Второе и следующие слова имён (фамилии) до конца имени, по алфавиту
+    int word_count;    // Количество записей в words
+    IndexDelta delta;  // Люди, добавленные или удалённые после построения
+    int enabled;       // 1, если индекс поддерживается (включается первым запросом)
+} NameSearchIndex;
+
+// Запрос, результат которого хранится в кэше запросов
+typedef enum {
+    CACHED_DESCENDANTS,  // get_descendants: потомки в порядке обхода
+    CACHED_ANCESTORS,    // get_ancestors: предки в порядке обхода
+    CACHED_DISTANCE      // shortest_relation_path: длина пути
+} CachedQuery;
+
+// Запись кэша запросов
+typedef struct {
+    int op;        // CachedQuery
+    int a, b;      // Индексы людей из запроса (b = -1, если второго нет)
+    int value;     // Длина пути или количество индексов в ids
+    int* ids;      // Найденные люди в порядке обхода (NULL для CACHED_DISTANCE)
+    int prev;      // Соседние записи в списке LRU (-1 — нет)
+    int next;
+    int chain;     // Следующая запись в корзине хэш-таблицы или в списке свободных
+} QueryCacheEntry;
+
+// Ограниченный LRU-кэш результатов запросов. Записи действительны только для
+// версии графа, при которой были сохранены: любое изменение графа увеличивает
+// версию, и при следующем обращении кэш очищается целиком.
+typedef struct {
+    int capacity;             // Максимум записей (0 — кэш выключен)
+    int count;                // Текущее количество записей
+    QueryCacheEntry* entries; // Записи
+    int* buckets;             // Хэш-таблица: первая запись корзины (-1 — пусто)
+    int bucket_mask;          // Количество корзин минус 1
+    int head;                 // Последняя использованная запись
+    int tail;                 // Давно не использованная запись (вытесняется первой)
+    int free_list;            // Список свободных записей (по полю chain)
+    long stored_ids;          // Сумма длин списков ids во всех записях
+    unsigned long version;    // Версия графа, которой соответствуют записи
+    long hits;                // Запросов, получивших ответ из кэша
+    long misses;              // Запросов, выполненных обходом
+    long evictions;           // Вытеснено записей
+    long invalidations;       // Очисток кэша из-за изменения графа
+} QueryCache;
+
+// Счётчики кэша запросов
+typedef struct {
+    long hits;
+    long misses;
+    long evictions;
+    long invalidations;
+    int entries;    // Записей в кэше сейчас
+    int capacity;   // Максимум записей (0 — кэш выключен)
+} QueryCacheStats;
+
 // Основная структура графа
 typedef struct {
-    Vertex* vertices;           // Динамический массив всех вершин графа
-    int size;                   // Количество добавленных вершин
+    Vertex* vertices;           // Динамический массив всех вершин графа (включая удалённые слоты)
+    PersonColumns people;       // Пол и годы жизни людей по столбцам (индексы как у vertices)
+    int size;                   // Количество занятых слотов массива vertices
     int capacity;               // Текущая вместимость массива vertices
+    int live_count;             // Количество людей в графе (без удалённых слотов)
+    int* free_slots;            // Стек индексов удалённых слотов для повторного использования
+    int free_count;             // Количество индексов в free_slots
+    int free_capacity;          // Вместимость free_slots
+    int edge_count;             // Общее количество рёбер в графе
     NameHashTable* name_index;  // Хэш-таблица для быстрого поиска по имени
+    Arena arena;                // Арена для рёбер, узлов очереди и имён
+    Edge* free_edges;           // Список освобождённых рёбер для повторного использования
+    int edges_pending;          // 1 — списки рёбер ещё не построены по CSR снимка (см. load_snapshot)
+    NamePool names;             // Освобождённые имена для повторного использования
+    CsrView csr;                // CSR-снимок рёбер для обходов только на чтение
+    SearchScratch scratch;      // Буферы для shortest_relation_path
+    LevelTraversal traversal;   // Буферы обхода по уровням (см. graph_set_traversal)
+    KinshipIndex kinship;       // Индекс предков для запросов родства
+    LifespanIndex lifespan;     // Индекс отрезков жизни (см. lifespan_alive_in)
+    NameSearchIndex name_search; // Индекс для поиска по началу имени и с опечатками
+    ReachabilityIndex reach;    // Индекс достижимости для is_descendant
+    DescendantAggregates aggregates; // Сводки по потомкам (см. graph_enable_aggregates)
+    unsigned long version;      // Версия графа: увеличивается при каждом изменении
+    QueryCache query_cache;     // Кэш результатов запросов (см. graph_set_query_cache)
+    ThreadPool* pool;           // Пул потоков обхода по уровням (создаётся по требованию)
+    ThreadPool* batch_pool;     // Пул пакетных запросов, если им нужно другое число потоков
+    SearchScratch* worker_scratch; // Буферы поиска для каждого исполнителя пула
+    int worker_scratch_count;   // Количество буферов в worker_scratch
+    MappedFile snapshot;        // Файл снимка, из которого граф читает данные (см. load_snapshot)
 } Graph;
 
 // --- ФУНКЦИИ РАБОТЫ С ГРАФОМ ---
@@ -65,16 +417,34 @@ Graph* create_graph();
 
 /**
  * Освобождает всю память, связанную с графом (включая вершины, рёбра и таблицу имён).
+ * Рёбра, имена и узлы очередей живут в арене графа и освобождаются поблочно.
  * @param g Указатель на граф, который нужно удалить.
  */
 void free_graph(Graph* g);
 
+/**
+ * Строит (или перестраивает) компактный CSR-снимок рёбер графа.
+ * Все функции обхода работают по снимку; после add_relation/remove_relation/
+ * add_person/remove_person он помечается устаревшим и перестраивается
+ * при следующем запросе. Явный вызов позволяет заплатить за построение заранее.
+ * @param g Указатель на граф.
+ * @return 0 при успехе, -1 при ошибке выделения памяти.
+ */
+int graph_freeze(Graph* g);
+
+/**
+ * Освобождает CSR-снимок графа. Следующий обход построит его заново.
+ * @param g Указатель на граф.
+ */
+void graph_thaw(Graph* g);
+
 
 // --- ДОБАВЛЕНИЕ ДАННЫХ --- //
 
 /**
  * Добавляет нового человека (вершину) в граф.
  * Имя должно быть уникальным. Если имя уже существует, функция возвращает -1.
+ * Если есть слоты, освобождённые remove_person, человек занимает один из них.
  * @param g Указатель на граф.
  * @param p Структура Person с данными.
  * @return Индекс новой вершины в массиве или -1 при ошибке.
@@ -92,6 +462,25 @@ int add_person(Graph* g, Person p);
  */
 int add_relation(Graph* g, const char* from, const char* to, RelationType relation);
 
+/**
+ * То же, что add_relation, но по индексам вершин (без поиска имён).
+ * @param g Указатель на граф.
+ * @param from Индекс начальной вершины.
+ * @param to Индекс конечной вершины.
+ * @param relation Тип связи (PARENT или CHILD).
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int add_relation_index(Graph* g, int from, int to, RelationType relation);
+
+/**
+ * Заранее выделяет место под persons новых людей (массив вершин и таблица имён),
+ * чтобы массовая загрузка обходилась без перераспределений.
+ * @param g Указатель на граф.
+ * @param persons Ожидаемое количество добавляемых людей.
+ * @return 0 при успехе, -1 при ошибке выделения памяти.
+ */
+int graph_reserve(Graph* g, int persons);
+
 
 // --- ПОИСК --- //
 
@@ -103,19 +492,331 @@ int add_relation(Graph* g, const char* from, const char* to, RelationType relati
  */
 int find_person_index(Graph* g, const char* name);
 
+/**
+ * Ищет индекс человека по имени, заданному указателем и длиной
+ * (имя не обязано завершаться нулём — например, поле строки в буфере файла).
+ * @param g Указатель на граф.
+ * @param name Начало имени.
+ * @param len Длина имени в байтах.
+ * @return Индекс в массиве вершин или -1, если человек не найден.
+ */
+int find_person_index_n(Graph* g, const char* name, size_t len);
+
+/**
+ * Ищет людей, чьё имя начинается с prefix (без учёта регистра; ё равно е).
+ * Индекс имён строится при первом поиске и далее поддерживается
+ * add_person и remove_person.
+ * @param g Указатель на граф.
+ * @param prefix Начало имени.
+ * @param out Индексы найденных людей по алфавиту имён (освобождаются free).
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int search_names_prefix(Graph* g, const char* prefix, int** out);
+
+/**
+ * Ищет людей, у которых одно из слов имени после первого (фамилия) начинается
+ * с prefix, — например, «иванов» находит и Ивановых, и Ивановых-Петровых.
+ * @param g Указатель на граф.
+ * @param prefix Начало фамилии.
+ * @param out Индексы найденных людей по алфавиту фамилий (освобождаются free).
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int search_names_by_surname(Graph* g, const char* prefix, int** out);
+
+/**
+ * Ищет людей, у которых имя целиком или одно из его слов отличается от query
+ * не больше чем на max_distance правок (вставка, удаление или замена символа).
+ * @param g Указатель на граф.
+ * @param query Искомое имя или слово.
+ * @param max_distance Допустимое число правок (0..3).
+ * @param out Индексы найденных людей (освобождаются free).
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int search_names_fuzzy(Graph* g, const char* query, int max_distance, int** out);
+
+/**
+ * Возвращает данные человека по индексу вершины.
+ * @param g Указатель на граф.
+ * @param index Индекс вершины.
+ * @param out Данные человека (имя указывает на строку графа).
+ * @return 0 при успехе, -1, если индекс неверен или слот удалён.
+ */
+int get_person(const Graph* g, int index, Person* out);
+
+
+// --- ВЫБОРКИ ПО ГОДАМ --- //
+// Просматривают столбцы годов векторными инструкциями (AVX2 или SSE2, если
+// компилятор их поддерживает) и возвращают индексы людей по возрастанию.
+// Массив *out выделяется функцией и освобождается вызывающим (free).
+
+/**
+ * Считает живых людей (год смерти < 0).
+ * @param g Указатель на граф.
+ * @return Количество живых или -1 при ошибке.
+ */
+int count_alive(const Graph* g);
+
+/**
+ * Выбирает людей, родившихся в годы from..to включительно.
+ * @param g Указатель на граф.
+ * @param from Первый год диапазона.
+ * @param to Последний год диапазона.
+ * @param out Индексы найденных людей.
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int filter_by_birth_range(const Graph* g, int from, int to, int** out);
+
+/**
+ * Выбирает людей, живших в году year: родившихся не позже year и
+ * не умерших до него (умершие в year включаются).
+ * @param g Указатель на граф.
+ * @param year Год.
+ * @param out Индексы найденных людей.
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int alive_in_year(const Graph* g, int year, int** out);
+
+/**
+ * Выбирает людей, умерших раньше года year.
+ * @param g Указатель на граф.
+ * @param year Год.
+ * @param out Индексы найденных людей.
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int filter_died_before(const Graph* g, int year, int** out);
+
+/**
+ * Выбирает людей, живших в году year (как alive_in_year), по индексу отрезков жизни:
+ * O(log n + k) вместо просмотра всех людей. Индекс строится при первом вызове
+ * и далее поддерживается add_person, remove_person и set_death_year.
+ * Порядок индексов в *out не определён.
+ * @param g Указатель на граф.
+ * @param year Год.
+ * @param out Индексы найденных людей (освобождаются free).
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int lifespan_alive_in(Graph* g, int year, int** out);
+
+/**
+ * Выбирает людей, чья жизнь пересекается с годами from..to включительно:
+ * родившихся не позже to и не умерших до from. Использует тот же индекс,
+ * что и lifespan_alive_in. Порядок индексов в *out не определён.
+ * @param g Указатель на граф.
+ * @param from Первый год диапазона.
+ * @param to Последний год диапазона.
+ * @param out Индексы найденных людей (освобождаются free).
+ * @return Количество найденных людей или -1 при ошибке.
+ */
+int lifespan_overlapping(Graph* g, int from, int to, int** out);
+
 
 // --- ОБРАБОТКА СВЯЗЕЙ --- //
 
 /**
- * Выводит всех потомков заданного человека, обходя связи типа PARENT (BFS).
+ * Выводит всех потомков заданного человека, обходя связи типа PARENT по поколениям
+ * (см. graph_set_traversal).
  * @param g Указатель на граф.
  * @param name Имя начального человека.
  */
 void get_descendants(Graph* g, const char* name);
 
+/**
+ * Выводит всех предков заданного человека, обходя связи типа PARENT в обратную сторону
+ * по поколениям (см. graph_set_traversal).
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ */
+void get_ancestors(Graph* g, const char* name);
+
+/**
+ * Находит потомков или предков человека с разбивкой по поколениям.
+ * Внутри поколения люди идут в порядке обхода (как в get_descendants), а у поколений,
+ * раскрытых снизу вверх, — по возрастанию индекса.
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ * @param down 1 — потомки, 0 — предки.
+ * @param out Результат; освобождается free_generation_levels.
+ * @return 0 при успехе, -1, если человек не найден или не хватило памяти.
+ */
+int get_generations(Graph* g, const char* name, int down, GenerationLevels* out);
+
+/**
+ * Находит потомков или предков без печати, в том же порядке, что get_descendants
+ * и get_ancestors (результат тоже кэшируется).
+ * Массив принадлежит графу и действителен до следующего вызова функций графа.
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ * @param down 1 — потомки, 0 — предки.
+ * @param count Количество найденных людей.
+ * @return Индексы людей или NULL, если человек не найден или не хватило памяти.
+ */
+const int* relatives_view(Graph* g, const char* name, int down, int* count);
+
+/**
+ * То же, что relatives_view, с копированием в буфер вызывающего.
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ * @param down 1 — потомки, 0 — предки.
+ * @param ids Буфер на capacity индексов (может быть NULL при capacity == 0).
+ * @param capacity Вместимость ids.
+ * @return Количество найденных людей (записываются первые capacity) или -1 при ошибке.
+ */
+int find_relatives(Graph* g, const char* name, int down, int* ids, int capacity);
+
+/**
+ * Находит потомков или предков вместе с поколением каждого.
+ * Люди идут по поколениям, как в get_generations.
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ * @param down 1 — потомки, 0 — предки.
+ * @param out Буфер на capacity пар (может быть NULL при capacity == 0).
+ * @param capacity Вместимость out.
+ * @return Количество найденных людей (записываются первые capacity) или -1 при ошибке.
+ */
+int find_relatives_depth(Graph* g, const char* name, int down, PersonDepth* out, int capacity);
+
+/**
+ * Вызывает visit для каждого потомка или предка по поколениям.
+ * Посетитель не должен изменять граф.
+ * @param g Указатель на граф.
+ * @param name Имя начального человека.
+ * @param down 1 — потомки, 0 — предки.
+ * @param visit Посетитель; ненулевой результат останавливает обход.
+ * @param ctx Контекст, передаваемый посетителю.
+ * @return Количество вызовов visit или -1, если человек не найден или не хватило памяти.
+ */
+int visit_relatives(Graph* g, const char* name, int down, PersonVisitor visit, void* ctx);
+
+/**
+ * Освобождает результат get_generations.
+ * @param gl Результат (может быть NULL).
+ */
+void free_generation_levels(GenerationLevels* gl);
+
+/**
+ * Настраивает обход по уровням в get_descendants, get_ancestors и get_generations.
+ * Уровень раскрывается пулом потоков, если в нём достаточно рёбер: каждая вершина
+ * достаётся ребру с наименьшим рангом, поэтому результат совпадает с однопоточным.
+ * При раскрытии снизу вверх широкий уровень находится перебором ещё не найденных
+ * вершин с проверкой, есть ли среди их соседей вершины текущего уровня.
+ * @param g Указатель на граф.
+ * @param threads Исполнителей для широких уровней; 0 или 1 — все уровни в вызывающем потоке.
+ * @param bottom_up 1 — разрешить раскрытие снизу вверх.
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int graph_set_traversal(Graph* g, int threads, int bottom_up);
+
+/**
+ * Находит ближайшего общего предка двух людей (самого человека тоже можно считать предком,
+ * т.е. если a — предок b, ответом будет a). Ближайшим считается предок с минимальной суммой
+ * поколений до обоих людей. Используется индекс предков, перестраиваемый после изменений
+ * графа; если связи PARENT образуют цикл, поиск выполняется обходом графа.
+ * Степень родства: если оба поколения больше 0, люди — кузены степени
+ * min(depth_a, depth_b) - 1 (0 — братья и сёстры), удалённые на |depth_a - depth_b| поколений.
+ * @param g Указатель на граф.
+ * @param a Имя первого человека.
+ * @param b Имя второго человека.
+ * @param out Результат (заполняется и при отсутствии общего предка).
+ * @return 0, если общий предок найден, -1 иначе.
+ */
+int find_kinship(Graph* g, const char* a, const char* b, Kinship* out);
+
+/**
+ * Строит индекс достижимости и включает его поддержку: после изменений графа
+ * он будет перестроен при следующем вызове is_descendant.
+ * Для небольших графов строится полное транзитивное замыкание (битовые строки
+ * потомков, объединяемые по словам в обратном топологическом порядке), для больших —
+ * интервальные метки. Если связи PARENT образуют цикл, индекс не строится.
+ * @param g Указатель на граф.
+ * @return 0 при успехе, -1 при ошибке или цикле.
+ */
+int graph_build_reachability(Graph* g);
+
+/**
+ * Проверяет, является ли person потомком ancestor (по связям PARENT).
+ * Использует индекс достижимости, если он включён, иначе — обход в ширину.
+ * @param g Указатель на граф.
+ * @param ancestor Имя предполагаемого предка.
+ * @param person Имя предполагаемого потомка.
+ * @return 1 — да, 0 — нет, -1 — кто-то из людей не найден или ошибка.
+ */
+int is_descendant(Graph* g, const char* ancestor, const char* person);
+
+/**
+ * Выполняет пакет запросов расстояния и наследства параллельно на пуле потоков.
+ * Во время выполнения граф не должен изменяться: все потоки читают один CSR-снимок,
+ * у каждого исполнителя свои буферы поиска. Результаты ничего не печатают.
+ * @param g Указатель на граф.
+ * @param queries Массив запросов.
+ * @param results Массив результатов той же длины (заполняется функцией).
+ * @param count Количество запросов.
+ * @param threads Число потоков; 0 — уже созданный пул графа, а без него — по числу процессоров.
+ * @return 0 при успехе, -1 при ошибке (результаты отдельных запросов — в status).
+ */
+int run_batch_queries(Graph* g, const BatchQuery* queries, BatchResult* results, long count, int threads);
+
+/**
+ * Освобождает доли наследства в результатах run_batch_queries.
+ * @param results Массив результатов.
+ * @param count Количество результатов.
+ */
+void free_batch_results(BatchResult* results, long count);
+
+/**
+ * Включает или выключает поддержку сводок по потомкам (get_descendant_summary).
+ * При включении все сводки считаются устаревшими и вычисляются при первом чтении;
+ * далее add_person, add_relation, remove_relation, remove_person и set_death_year
+ * обновляют их сами. Для массовой загрузки сводки выгоднее включать после неё
+ * (load_from_file делает это автоматически).
+ * @param g Указатель на граф.
+ * @param enable 1 — включить, 0 — выключить и освободить память.
+ * @return 0 при успехе, -1 при ошибке выделения памяти.
+ */
+int graph_enable_aggregates(Graph* g, int enable);
+
+/**
+ * Возвращает число потомков, живых потомков и суммарный вес живых потомков
+ * (знаменатель формулы наследства). Со включёнными сводками (graph_enable_aggregates)
+ * повторные чтения не обходят граф; без них выполняется обход в ширину.
+ * @param g Указатель на граф.
+ * @param name Имя человека.
+ * @param out Результат.
+ * @return 0 при успехе, -1, если человек не найден или не хватило памяти.
+ */
+int get_descendant_summary(Graph* g, const char* name, DescendantSummary* out);
+
+/**
+ * Изменяет год смерти человека (отрицательный — человек жив).
+ * @param g Указатель на граф.
+ * @param name Имя человека.
+ * @param death_year Новый год смерти.
+ * @return 0 при успехе, -1, если человек не найден.
+ */
+int set_death_year(Graph* g, const char* name, int death_year);
+
+/**
+ * Включает кэш результатов get_descendants, get_ancestors и shortest_relation_path
+ * или меняет его размер. Повторный запрос с теми же людьми при неизменном графе
+ * отвечается из кэша без обхода; любое изменение графа (add_person, add_relation,
+ * remove_relation, remove_person, set_death_year) делает все записи недействительными.
+ * При переполнении вытесняется давно не использованная запись. Счётчики сохраняются.
+ * @param g Указатель на граф.
+ * @param entries Максимум записей (0 — выключить кэш и освободить память).
+ * @return 0 при успехе, -1 при ошибке выделения памяти.
+ */
+int graph_set_query_cache(Graph* g, int entries);
+
+/**
+ * Возвращает счётчики попаданий и промахов кэша запросов.
+ * @param g Указатель на граф.
+ * @param out Счётчики.
+ */
+void graph_query_cache_stats(const Graph* g, QueryCacheStats* out);
+
 /**
  * Находит кратчайший путь (по количеству связей) от одного человека до другого.
- * Использует алгоритм Дейкстры с единичными весами рёбер.
+ * Использует двунаправленный поиск в ширину: прямой фронт идёт по исходящим рёбрам
+ * от from, обратный — по входящим рёбрам от to, пока фронты не встретятся.
  * @param g Указатель на граф.
  * @param from Имя начальной вершины.
  * @param to Имя конечной вершины.
@@ -133,6 +834,18 @@ int shortest_relation_path(Graph* g, const char* from, const char* to);
  */
 void distribute_inheritance(Graph* g, const char* name, double amount);
 
+/**
+ * Считает доли наследства так же, как distribute_inheritance, без печати.
+ * Доли идут по возрастанию индекса наследника.
+ * @param g Указатель на граф.
+ * @param name Имя наследодателя.
+ * @param amount Общая сумма наследства.
+ * @param out Буфер на capacity долей (может быть NULL при capacity == 0).
+ * @param capacity Вместимость out.
+ * @return Количество живых потомков (записываются первые capacity) или -1 при ошибке.
+ */
+int compute_inheritance(Graph* g, const char* name, double amount, InheritanceShare* out, int capacity);
+
 
 // --- УТИЛИТЫ --- //
 
@@ -148,11 +861,37 @@ void print_graph(Graph* g);
 
 /**
  * Экспортирует граф в файл формата DOT (Graphviz).
+ * Вершины получают числовые идентификаторы (индексы) с именем в метке,
+ * вывод идёт через большой буфер.
  * @param g Указатель на граф.
  * @param dot_path Путь к выходному .dot-файлу.
  */
 void export_dot(const Graph *g, const char *dot_path);
 
+/**
+ * Экспортирует в DOT только окрестность человека: всех, до кого не больше
+ * generations шагов по связям в любом направлении (предки, потомки, их родня),
+ * и связи между ними. Позволяет рисовать часть очень большого графа.
+ * @param g Указатель на граф.
+ * @param dot_path Путь к выходному .dot-файлу.
+ * @param name Имя человека в центре окрестности.
+ * @param generations Радиус окрестности в поколениях (0 — только сам человек).
+ * @return Количество выгруженных людей или -1 при ошибке.
+ */
+int export_dot_neighbourhood(Graph* g, const char* dot_path, const char* name, int generations);
+
+/**
+ * Формирует текст DOT в памяти — весь граф или окрестность человека (как в
+ * export_dot_neighbourhood). Текст отражает граф на момент вызова и не зависит
+ * от дальнейших изменений, поэтому его можно передать другому потоку.
+ * @param g Указатель на граф.
+ * @param name Имя человека в центре окрестности или NULL для всего графа.
+ * @param generations Радиус окрестности в поколениях (при name == NULL не используется).
+ * @param size Длина текста в байтах (может быть NULL).
+ * @return Буфер с текстом (освобождается free) или NULL при ошибке.
+ */
+char* export_dot_buffer(Graph* g, const char* name, int generations, size_t* size);
+
 /**
  * Вызывает утилиту dot (Graphviz) для генерации svg-изображения из .dot-файла.
  * @param dot_path Путь к входному .dot-файлу.
@@ -177,10 +916,58 @@ int remove_relation(Graph* g, const char* from, const char* to, RelationType rel
 /**
  * Удаляет человека из графа вместе со всеми его связями.
  * Автоматически удаляет все рёбра, в которых он участвовал.
+ * Индексы остальных вершин не меняются: слот помечается удалённым и
+ * позже переиспользуется add_person. Затрагиваются только соседи удаляемого.
+ * Память копии имени переиспользуется графом: указатели на имя удалённого
+ * человека (например, полученные get_person) после вызова недействительны.
  * @param g Указатель на граф.
  * @param name Имя человека для удаления.
  * @return 0 при успехе, -1 если человек не найден.
  */
 int remove_person(Graph* g, const char* name);
 
+
+// --- БИНАРНЫЙ СНИМОК --- //
+
+/**
+ * Сохраняет граф в бинарный файл снимка: записи людей, пул строк с именами,
+ * CSR-массивы рёбер (прямые и обратные) и ячейки таблицы имён.
+ * Формат версионирован и рассчитан на отображение в память при загрузке.
+ * @param g Указатель на граф.
+ * @param path Путь к файлу снимка.
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int save_snapshot(Graph* g, const char* path);
+
+/**
+ * Загружает граф из файла снимка, созданного save_snapshot.
+ * Файл отображается в память с копированием при записи, и граф работает прямо с ним:
+ * столбцы людей, CSR-снимок и таблица имён не копируются, имена указывают в пул строк
+ * файла. Заново строится только массив вершин; списки рёбер строятся по CSR при первом
+ * изменении связей. Файл остаётся отображённым до free_graph.
+ * Содержимое один раз проверяется на чтение: снимок с некорректным UTF-8 в именах,
+ * с индексами за границами массивов, со счётчиками заголовка, расходящимися
+ * с содержимым, или с таблицей имён, ссылающейся не на живых людей, отвергается.
+ * @param path Путь к файлу снимка.
+ * @return Новый граф или NULL, если файл не найден, повреждён или другой версии.
+ */
+Graph* load_snapshot(const char* path);
+
+/**
+ * Печатает статистику операций: число вызовов, время (сумма, среднее, p50/p99 по
+ * логарифмической гистограмме, максимум), просмотренные рёбра, длины проб поиска
+ * имён и счётчики выделений памяти.
+ * Статистика собирается только при сборке graph.c с -DGRAPH_STATS; иначе печатается
+ * одна строка о том, что она отключена, а замеры не стоят ничего.
+ * Если задана переменная окружения GRAPH_STATS_DUMP ("1"/"stderr" или путь к файлу),
+ * статистика печатается туда при выходе из программы.
+ * @param out Поток вывода (NULL — stdout).
+ */
+void graph_stats_dump(FILE* out);
+
+/**
+ * Обнуляет накопленную статистику операций.
+ */
+void graph_stats_reset(void);
+
 #endif
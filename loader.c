@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "mmfile.h"
+#include "threadpool.h"
+#include "utf8.h"
+#include "loader.h"
+
+#define RED        "\x1b[1;31m"
+#define GREEN      "\x1b[1;32m"
+#define YELLOW     "\x1b[1;33m"
+#define RESET      "\x1b[0m"
+
+#define MAX_REPORTED_ERRORS 20 // сколько ошибок выводить подробно, остальные только считаются
+#define LOADER_CHUNK_BYTES (1 << 20) // размер куска файла, разбираемого одним потоком за раунд
+#define LOADER_PARALLEL_MIN_BYTES (4 << 20) // файлы меньше этого размера по умолчанию грузятся в один поток
+#define LOADER_MAX_THREADS 64 // предел числа потоков разбора
+
+
+// ----------- Разбор строк -------------- //
+// Поле строки: указатель в буфер файла и длина
+typedef struct {
+    const char* ptr;
+    size_t len;
+} Field;
+
+// Буфер для копии поля с завершающим нулём
+typedef struct {
+    char* ptr;
+    size_t cap;
+} TextBuffer;
+
+// Копирует поле в буфер; при sanitize удаляет некорректные последовательности UTF-8.
+// Возвращает длину копии или -1, если не хватило памяти
+static long copy_field(TextBuffer* b, Field f, int sanitize) {
+    if (f.len + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap < f.len + 1) cap *= 2;
+        char* tmp = realloc(b->ptr, cap);
+        if (!tmp) return -1;
+        b->ptr = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->ptr, f.ptr, f.len);
+    size_t len = sanitize ? utf8_sanitize(b->ptr, f.len) : f.len;
+    b->ptr[len] = '\0';
+    return (long)len;
+}
+
+// Находит конец строки, начинающейся в p; *next — начало следующей строки
+static const char* line_end(const char* p, const char* end, const char** next) {
+    const char* nl = memchr(p, '\n', (size_t)(end - p));
+    const char* e = nl ? nl : end;
+    *next = nl ? nl + 1 : end;
+    if (e > p && e[-1] == '\r') e--; // файлы с переводами строк Windows
+    return e;
+}
+
+// Делит строку [p, e) по ';' на не более чем max полей; возвращает их число
+static int split_fields(const char* p, const char* e, Field* fields, int max) {
+    int n = 0;
+    while (n < max) {
+        const char* sep = memchr(p, ';', (size_t)(e - p));
+        const char* fe = sep ? sep : e;
+        fields[n].ptr = p;
+        fields[n].len = (size_t)(fe - p);
+        n++;
+        if (!sep) break;
+        p = sep + 1;
+    }
+    return n;
+}
+
+// Разбирает целое число, занимающее поле целиком
+static int parse_int(Field f, int* out) {
+    size_t i = 0;
+    int neg = 0;
+    if (i < f.len && (f.ptr[i] == '-' || f.ptr[i] == '+')) neg = f.ptr[i++] == '-';
+    if (i == f.len) return -1;
+    long v = 0;
+    for (; i < f.len; i++) {
+        if (f.ptr[i] < '0' || f.ptr[i] > '9') return -1;
+        v = v * 10 + (f.ptr[i] - '0');
+        if (v > 1000000000L) return -1;
+    }
+    *out = (int)(neg ? -v : v);
+    return 0;
+}
+
+// Итог разбора одной строки
+typedef enum {
+    LINE_OK,            // Строка корректна и добавлена (или готова к добавлению)
+    LINE_EMPTY,         // Пустая строка (разделитель секций)
+    LINE_BAD_PERSON,    // Неверное число полей в строке человека
+    LINE_BAD_YEAR,      // Год не является целым числом
+    LINE_DUPLICATE,     // Имя уже есть в графе
+    LINE_BAD_RELATION,  // Неверное число полей в строке связи
+    LINE_UNKNOWN_NAME,  // В связи упомянут неизвестный человек
+    LINE_ADD_FAILED     // Не удалось добавить связь
+} LineStatus;
+
+static const char* line_status_message(LineStatus status) {
+    switch (status) {
+        case LINE_BAD_PERSON:   return "ожидается 'имя;пол;рождение;смерть'";
+        case LINE_BAD_YEAR:     return "год должен быть целым числом";
+        case LINE_DUPLICATE:    return "имя уже есть в графе";
+        case LINE_BAD_RELATION: return "ожидается 'родитель;ребёнок'";
+        case LINE_UNKNOWN_NAME: return "неизвестное имя в связи";
+        case LINE_ADD_FAILED:   return "не удалось добавить связь";
+        default:                return "";
+    }
+}
+
+// Разобранная строка файла
+typedef struct {
+    LineStatus status;  // Итог разбора
+    long line;          // Номер строки внутри куска (с 1)
+    Field name;         // Люди: имя (указывает в буфер файла)
+    Gender gender;      // Люди: пол
+    int birth_year;     // Люди: год рождения
+    int death_year;     // Люди: год смерти
+    int parent;         // Связи: индекс родителя
+    int child;          // Связи: индекс ребёнка
+    const char* bad_utf8; // Первая некорректная последовательность UTF-8 в строке или NULL
+    int bad_utf8_count;   // Сколько таких последовательностей в строке
+} ParsedLine;
+
+// ожидаем: name;gender;birth;death
+static LineStatus parse_person_line(const char* p, const char* e, ParsedLine* out) {
+    Field f[4];
+    int nf = split_fields(p, e, f, 4);
+    if (nf < 4 || f[0].len == 0 || f[1].len == 0) return LINE_BAD_PERSON;
+    if (parse_int(f[2], &out->birth_year) != 0 || parse_int(f[3], &out->death_year) != 0)
+        return LINE_BAD_YEAR;
+    out->name = f[0];
+    out->gender = (toupper((unsigned char)f[1].ptr[0]) == 'M' ? MALE : FEMALE);
+    return LINE_OK;
+}
+
+
+
+// ----------- Разбор кусков файла -------------- //
+// Кусок секции, разбираемый одним потоком в собственный буфер строк
+typedef struct {
+    Graph* g;             // Граф (для связей: только поиск имён, без изменений)
+    int relations;        // 1 — секция связей, 0 — секция людей
+    const char* begin;    // Начало куска (начало строки)
+    const char* end;      // Конец куска (после перевода строки)
+    ParsedLine* lines;    // Разобранные строки
+    long count;           // Количество разобранных строк
+    long capacity;        // Вместимость lines
+    long line_total;      // Количество строк куска, включая пустые
+    TextBuffer text;      // Очищенное от некорректного UTF-8 имя из строки связи
+    int failed;           // 1, если не хватило памяти
+} Chunk;
+
+// Ищет человека по полю строки связи; имя из строки с некорректным UTF-8
+// очищается так же, как при добавлении людей
+static int find_field(Chunk* c, Field f, int sanitize) {
+    if (!sanitize) return find_person_index_n(c->g, f.ptr, f.len);
+    long len = copy_field(&c->text, f, 1);
+    if (len < 0) {
+        c->failed = 1;
+        return -1;
+    }
+    return find_person_index_n(c->g, c->text.ptr, (size_t)len);
+}
+
+// секция связей: parent;child (имена сразу переводятся в индексы)
+static LineStatus parse_relation_line(Chunk* c, const char* p, const char* e, ParsedLine* out) {
+    Field f[2];
+    int nf = split_fields(p, e, f, 2);
+    if (nf < 2 || f[0].len == 0 || f[1].len == 0) return LINE_BAD_RELATION;
+    out->parent = find_field(c, f[0], out->bad_utf8 != NULL);
+    out->child = find_field(c, f[1], out->bad_utf8 != NULL);
+    if (out->parent < 0 || out->child < 0) return LINE_UNKNOWN_NAME;
+    return LINE_OK;
+}
+
+static void* parse_chunk(void* arg) {
+    Chunk* c = arg;
+    const char* p = c->begin;
+    c->count = 0;
+    c->line_total = 0;
+    c->failed = 0;
+    // весь кусок проверяется на UTF-8 сразу; строки с ошибками только помечаются
+    size_t bad_len = 0;
+    const char* bad = p + utf8_find_invalid(p, (size_t)(c->end - p), &bad_len);
+    while (p < c->end) {
+        const char* next;
+        const char* e = line_end(p, c->end, &next);
+        c->line_total++;
+        if (c->count >= c->capacity) {
+            long cap = c->capacity ? c->capacity * 2 : 1024;
+            ParsedLine* tmp = realloc(c->lines, sizeof(ParsedLine) * cap);
+            if (!tmp) { c->failed = 1; break; }
+            c->lines = tmp;
+            c->capacity = cap;
+        }
+        ParsedLine* pl = &c->lines[c->count++];
+        pl->line = c->line_total;
+        pl->bad_utf8 = NULL;
+        pl->bad_utf8_count = 0;
+        // последовательность не может захватить перевод строки, поэтому лежит в одной строке
+        if (bad < next) pl->bad_utf8 = bad;
+        while (bad < next) {
+            pl->bad_utf8_count++;
+            bad += bad_len;
+            bad += utf8_find_invalid(bad, (size_t)(c->end - bad), &bad_len);
+        }
+        if (e == p) pl->status = LINE_EMPTY;
+        else if (c->relations) pl->status = parse_relation_line(c, p, e, pl);
+        else pl->status = parse_person_line(p, e, pl);
+        p = next;
+    }
+    return NULL;
+}
+
+// Конец куска: примерно через bytes байт, выровненный на начало следующей строки
+static const char* chunk_end(const char* p, const char* end, size_t bytes) {
+    if ((size_t)(end - p) <= bytes) return end;
+    const char* nl = memchr(p + bytes, '\n', (size_t)(end - (p + bytes)));
+    return nl ? nl + 1 : end;
+}
+
+// Состояние загрузки, общее для всех кусков
+typedef struct {
+    const char* filename;
+    Graph* g;
+    const char* data;     // Начало содержимого файла (для смещений в сообщениях)
+    LoadStats st;
+    long line_base;       // Номер строки, предшествующей текущему куску
+    TextBuffer name;      // Буфер для имени с завершающим нулём (нужен add_person)
+    int failed;
+} LoadState;
+
+static void report_error(LoadState* ls, long line_no, LineStatus status) {
+    if (++ls->st.errors <= MAX_REPORTED_ERRORS)
+        fprintf(stderr, YELLOW "%s:%ld: %s\n" RESET, ls->filename, line_no, line_status_message(status));
+}
+
+static void report_utf8(LoadState* ls, long line_no, const ParsedLine* pl) {
+    if (++ls->st.invalid_utf8 <= MAX_REPORTED_ERRORS)
+        fprintf(stderr, YELLOW "%s:%ld: некорректный UTF-8 со смещения %ld (последовательностей: %d), байты удалены\n" RESET,
+                ls->filename, line_no, (long)(pl->bad_utf8 - ls->data), pl->bad_utf8_count);
+}
+
+// Переносит разобранные строки куска в граф в порядке файла
+static void merge_chunk(LoadState* ls, const Chunk* c) {
+    for (long i = 0; i < c->count && !ls->failed; i++) {
+        const ParsedLine* pl = &c->lines[i];
+        LineStatus status = pl->status;
+        if (pl->bad_utf8) report_utf8(ls, ls->line_base + pl->line, pl);
+        if (status == LINE_EMPTY) continue;
+        if (status == LINE_OK && !c->relations) {
+            long len = copy_field(&ls->name, pl->name, pl->bad_utf8 != NULL);
+            if (len < 0) { ls->failed = 1; break; }
+            Person person;
+            person.name = ls->name.ptr;
+            person.gender = pl->gender;
+            person.birth_year = pl->birth_year;
+            person.death_year = pl->death_year;
+            if (len == 0) status = LINE_BAD_PERSON; // имя состояло только из некорректных байтов
+            else if (add_person(ls->g, person) >= 0) ls->st.persons++;
+            else status = LINE_DUPLICATE;
+        } else if (status == LINE_OK) {
+            if (add_relation_index(ls->g, pl->parent, pl->child, PARENT) == 0) ls->st.relations++;
+            else status = LINE_ADD_FAILED;
+        }
+        if (status != LINE_OK) report_error(ls, ls->line_base + pl->line, status);
+    }
+    ls->line_base += c->line_total;
+}
+
+// Разбирает секцию [p, end) раундами: каждый поток получает по куску, затем куски
+// по порядку переносятся в граф. Люди добавляются последовательно, поэтому
+// повторное имя отвергается так же, как при обычной загрузке.
+static void load_section(LoadState* ls, const char* p, const char* end, int relations,
+                         Chunk* chunks, int threads) {
+    while (p < end && !ls->failed) {
+        int used = 0;
+        for (; used < threads && p < end; used++) {
+            chunks[used].g = ls->g;
+            chunks[used].relations = relations;
+            chunks[used].begin = p;
+            chunks[used].end = p = chunk_end(p, end, LOADER_CHUNK_BYTES);
+        }
+        pthread_t tids[LOADER_MAX_THREADS];
+        int started[LOADER_MAX_THREADS] = {0};
+        for (int i = 1; i < used; i++)
+            started[i] = pthread_create(&tids[i], NULL, parse_chunk, &chunks[i]) == 0;
+        parse_chunk(&chunks[0]);
+        for (int i = 1; i < used; i++) {
+            if (started[i]) pthread_join(tids[i], NULL);
+            else parse_chunk(&chunks[i]); // поток не создался — разбираем сами
+        }
+        for (int i = 0; i < used && !ls->failed; i++) {
+            if (chunks[i].failed) ls->failed = 1;
+            else merge_chunk(ls, &chunks[i]);
+        }
+    }
+}
+
+// Начало первой пустой строки (разделителя секций) или end; *lines — число строк до неё
+static const char* find_section_break(const char* p, const char* end, long* lines) {
+    *lines = 0;
+    while (p < end) {
+        const char* next;
+        const char* e = line_end(p, end, &next);
+        if (e == p) return p;
+        (*lines)++;
+        p = next;
+    }
+    return end;
+}
+
+long load_from_file_parallel(const char* filename, Graph* g, LoadStats* stats, int threads) {
+    MappedFile mf;
+    if (map_file(filename, &mf) != 0) {
+        fprintf(stderr, RED "Не удалось открыть файл %s\n" RESET, filename);
+        return -1;
+    }
+    if (threads <= 0)
+        threads = mf.size < LOADER_PARALLEL_MIN_BYTES ? 1 : thread_pool_default_size();
+    if (threads > LOADER_MAX_THREADS) threads = LOADER_MAX_THREADS;
+
+    const char* p = mf.data;
+    const char* end = mf.data + mf.size;
+    long person_lines;
+    const char* brk = find_section_break(p, end, &person_lines);
+    graph_reserve(g, (int)person_lines);
+    // сводки по потомкам дешевле пересчитать после загрузки, чем вести на каждой связи
+    int aggregates = g->aggregates.enabled;
+    if (aggregates) graph_enable_aggregates(g, 0);
+
+    LoadState ls;
+    memset(&ls, 0, sizeof(ls));
+    ls.filename = filename;
+    ls.data = mf.data;
+    ls.g = g;
+    Chunk* chunks = calloc(threads, sizeof(Chunk));
+    if (chunks) {
+        load_section(&ls, p, brk, 0, chunks, threads);
+        if (brk < end && !ls.failed) {
+            // пустая строка-разделитель тоже занимает номер строки
+            const char* next;
+            line_end(brk, end, &next);
+            ls.line_base++;
+            load_section(&ls, next, end, 1, chunks, threads);
+        }
+        for (int i = 0; i < threads; i++) {
+            free(chunks[i].lines);
+            free(chunks[i].text.ptr);
+        }
+        free(chunks);
+    } else {
+        ls.failed = 1;
+    }
+    free(ls.name.ptr);
+    unmap_file(&mf);
+    if (aggregates && graph_enable_aggregates(g, 1) != 0)
+        fprintf(stderr, YELLOW "Недостаточно памяти: сводки по потомкам отключены и будут считаться при каждом запросе\n" RESET);
+
+    LoadStats st = ls.st;
+    if (ls.failed)
+        fprintf(stderr, RED "Недостаточно памяти: файл %s загружен не полностью\n" RESET, filename);
+    if (st.errors > MAX_REPORTED_ERRORS)
+        fprintf(stderr, YELLOW "... и ещё %ld строк с ошибками\n" RESET, st.errors - MAX_REPORTED_ERRORS);
+    printf(GREEN "Данные загружены из %s (людей: %ld, связей: %ld)\n" RESET,
+           filename, st.persons, st.relations);
+    if (st.errors > 0)
+        printf(RED "Строк с ошибками: %ld\n" RESET, st.errors);
+    if (st.invalid_utf8 > 0)
+        printf(YELLOW "Строк с некорректным UTF-8 (байты удалены): %ld\n" RESET, st.invalid_utf8);
+    if (stats) *stats = st;
+    return st.errors;
+}
+
+long load_from_file(const char* filename, Graph* g, LoadStats* stats) {
+    return load_from_file_parallel(filename, g, stats, 0);
+}
@@ -0,0 +1,45 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "graph.h"
+
+// Итоги загрузки файла
+typedef struct {
+    long persons;    // Сколько людей добавлено
+    long relations;  // Сколько связей добавлено
+    long errors;     // Сколько строк отклонено (с указанием номера строки в stderr)
+    long invalid_utf8; // Сколько строк содержали некорректный UTF-8 (такие байты удаляются из имён)
+} LoadStats;
+
+/**
+ * Загружает людей и связи из текстового файла в граф.
+ * Формат: сначала строки "имя;пол;год рождения;год смерти", затем пустая строка,
+ * затем строки "родитель;ребёнок".
+ * Файл отображается в память и разбирается на месте, без копирования строк;
+ * массив вершин и таблица имён заранее расширяются по числу строк первой секции.
+ * Некорректные строки не добавляются, о каждой сообщается в stderr с номером строки.
+ * Содержимое проверяется на UTF-8 целиком (см. utf8_find_invalid); некорректные
+ * последовательности удаляются из имён, о строке сообщается со смещением в файле.
+ * @param filename Путь к файлу.
+ * @param g Указатель на граф.
+ * @param stats Итоги загрузки (может быть NULL).
+ * Большие файлы разбираются параллельно (см. load_from_file_parallel).
+ * @return Количество строк с ошибками или -1, если файл не удалось открыть.
+ */
+long load_from_file(const char* filename, Graph* g, LoadStats* stats);
+
+/**
+ * То же, что load_from_file, с явным числом потоков разбора.
+ * Каждая секция делится на куски по строкам; потоки разбирают куски в собственные
+ * буферы (для связей — сразу с поиском имён в уже заполненной таблице), после чего
+ * куски по порядку переносятся в граф. Результат (граф, отвергнутые повторные имена,
+ * номера строк в сообщениях) совпадает с однопоточной загрузкой.
+ * @param filename Путь к файлу.
+ * @param g Указатель на граф.
+ * @param stats Итоги загрузки (может быть NULL).
+ * @param threads Число потоков; 0 — по числу ядер для больших файлов и 1 для маленьких.
+ * @return Количество строк с ошибками или -1, если файл не удалось открыть.
+ */
+long load_from_file_parallel(const char* filename, Graph* g, LoadStats* stats, int threads);
+
+#endif
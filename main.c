@@ -1,9 +1,19 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime в замерах пакетного режима (-std=c11 его скрывает)
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 #include "graph.h"
+#include "loader.h"
+#include "render.h"
+#include "utf8.h"
 
 #define RED        "\x1b[1;31m"
 #define GREEN      "\x1b[1;32m"
@@ -11,6 +21,11 @@
 #define CYAN       "\x1b[1;36m"
 #define RESET      "\x1b[0m"
 
+#define BATCH_LINE_SIZE 4096 // максимальная длина строки пакетного режима
+#define BATCH_MAX_ARGS 4     // максимум аргументов команды (через ';')
+#define BATCH_OUT_BUFFER (1 << 20) // буфер stdout в пакетном режиме
+#define QUERY_CACHE_ENTRIES 256    // записей в кэше результатов запросов
+
 static void print_menu() {
     printf("\n" CYAN "=== Меню ===\n" RESET);
     printf("1) Добавить новую вершину (человек)\n");
@@ -23,108 +38,17 @@ static void print_menu() {
     printf("8) Распределить наследство\n");
     printf("9) Загрузить данные из файла\n");
     printf("10) Показать всех потомков заданного человека\n");
+    printf("11) Показать всех предков заданного человека\n");
+    printf("12) Найти ближайшего общего предка и степень родства\n");
+    printf("13) Сохранить бинарный снимок графа\n");
+    printf("14) Загрузить бинарный снимок графа\n");
+    printf("15) Показать статистику операций\n");
+    printf("16) Найти людей по началу имени или фамилии\n");
     printf("0) Выход\n");
     printf("Выберите опцию: ");
 }
 
 
-void load_from_file(const char *filename, Graph *g) {
-    FILE *f = fopen(filename, "r");
-    if (!f) {
-        fprintf(stderr, RED "Не удалось открыть файл %s\n" RESET, filename);
-        return;
-    }
-    char line[256];
-    enum { SECTION_PERSONS, SECTION_RELATIONS } section = SECTION_PERSONS;
-    while (fgets(line, sizeof(line), f)) {
-        // убираем '\n'
-        line[strcspn(line, "\n")] = 0;
-        if (line[0] == '\0') {
-            // пустая строка — переходим к секции связей
-            section = SECTION_RELATIONS;
-            continue;
-        }
-        if (section == SECTION_PERSONS) {
-            // ожидаем: name;gender;birth;death
-            char *name = strtok(line, ";");
-            char *gndr = strtok(NULL, ";");
-            char *birth = strtok(NULL, ";");
-            char *death = strtok(NULL, ";");
-            if (name && gndr && birth && death) {
-                Person p;
-                p.name = name;
-                p.gender = (toupper(gndr[0]) == 'M' ? MALE : FEMALE);
-                p.birth_year = atoi(birth);
-                p.death_year = atoi(death);
-                add_person(g, p);
-            }
-        } else {
-            // секция связей: parent;child
-            char *parent = strtok(line, ";");
-            char *child  = strtok(NULL, ";");
-            if (parent && child) {
-                add_relation(g, parent, child, PARENT);
-            }
-        }
-    }
-    fclose(f);
-    printf(GREEN "Данные загружены из %s\n" RESET, filename);
-}
-
-
-// Проверка и фильтрация валидных UTF-8 последовательностей
-static void filter_valid_utf8(char* buf) {
-    unsigned char* s = (unsigned char*)buf;
-    size_t len = strlen(buf);
-    size_t i = 0, j = 0;
-    while (i < len) {
-        unsigned char c = s[i];
-        if (c < 0x80) {
-            s[j++] = c;
-            i++;
-        } else if (c >= 0xC2 && c <= 0xDF) {
-            if (i + 1 < len) {
-                unsigned char c1 = s[i+1];
-                if ((c1 & 0xC0) == 0x80) {
-                    s[j++] = c;
-                    s[j++] = c1;
-                    i += 2;
-                    continue;
-                }
-            }
-            i++;
-        } else if (c >= 0xE0 && c <= 0xEF) {
-            if (i + 2 < len) {
-                unsigned char c1 = s[i+1], c2 = s[i+2];
-                if ((c1 & 0xC0) == 0x80 && (c2 & 0xC0) == 0x80) {
-                    s[j++] = c;
-                    s[j++] = c1;
-                    s[j++] = c2;
-                    i += 3;
-                    continue;
-                }
-            }
-            i++;
-        } else if (c >= 0xF0 && c <= 0xF4) {
-            if (i + 3 < len) {
-                unsigned char c1 = s[i+1], c2 = s[i+2], c3 = s[i+3];
-                if ((c1 & 0xC0) == 0x80 && (c2 & 0xC0) == 0x80 && (c3 & 0xC0) == 0x80) {
-                    s[j++] = c;
-                    s[j++] = c1;
-                    s[j++] = c2;
-                    s[j++] = c3;
-                    i += 4;
-                    continue;
-                }
-            }
-            i++;
-        } else {
-            i++;
-        }
-    }
-    s[j] = '\0';
-}
-
 // Чтение строки из stdin с удалением ведущих/концевых пробельных символов и фильтрацией UTF-8
 static void read_line(char* buf, int size) {
     if (!fgets(buf, size, stdin)) {
@@ -141,16 +65,417 @@ static void read_line(char* buf, int size) {
         end--;
     }
     if (start != buf) memmove(buf, start, strlen(start) + 1);
-    filter_valid_utf8(buf);
+    buf[utf8_sanitize(buf, strlen(buf))] = '\0';
+}
+
+// Печатает статистику операций и счётчики кэша запросов
+static void print_stats(const Graph* g) {
+    graph_stats_dump(stdout);
+    QueryCacheStats cs;
+    graph_query_cache_stats(g, &cs);
+    printf("Кэш запросов: попаданий %ld, промахов %ld, вытеснено %ld, очисток %ld, записей %d из %d\n",
+           cs.hits, cs.misses, cs.evictions, cs.invalidations, cs.entries, cs.capacity);
+}
+
+// Сообщает о завершённых фоновых отрисовках
+static void report_renders(SvgRenderer* r) {
+    RenderResult res;
+    while (svg_renderer_poll(r, &res)) {
+        if (res.ok)
+            printf(GREEN "\nРисунок %s готов (%.2f с)" RESET, res.svg_path, res.seconds);
+        else
+            printf(RED "\nНе удалось нарисовать %s (код dot: %d)" RESET, res.svg_path, res.exit_code);
+        if (res.superseded > 0)
+            printf(YELLOW " — пропущено устаревших запросов: %ld" RESET, res.superseded);
+    }
 }
 
-int main() {
+// ----------- Пакетный режим -------------- //
+// Команды пакетного режима: слово команды, пробел, аргументы через ';'
+typedef enum {
+    CMD_PERSON, CMD_RELATION, CMD_REMOVE_PERSON, CMD_REMOVE_RELATION, CMD_DISTANCE,
+    CMD_INHERIT, CMD_DESCENDANTS, CMD_ANCESTORS, CMD_LOAD, CMD_EXPORT, CMD_STATS,
+    CMD_DEATH, CMD_SUMMARY, CMD_AGGREGATES, CMD_ALIVE, CMD_BORN, CMD_ALIVE_IN, CMD_DIED_BEFORE,
+    CMD_OVERLAP, CMD_FIND_PREFIX, CMD_FIND_SURNAME, CMD_FIND_FUZZY, CMD_GENERATIONS,
+    CMD_TRAVERSAL, CMD_COUNT_RELATIVES,
+    CMD_COUNT
+} BatchCommand;
+
+static const struct {
+    const char* name;  // Слово команды
+    int min_args;      // Сколько аргументов обязательно
+    int max_args;      // Сколько аргументов допустимо
+    const char* usage; // Подсказка для сообщения об ошибке
+} batch_commands[CMD_COUNT] = {
+    { "person",          4, 4, "person имя;M|F;год рождения;год смерти" },
+    { "relation",        2, 2, "relation родитель;ребёнок" },
+    { "remove_person",   1, 1, "remove_person имя" },
+    { "remove_relation", 2, 2, "remove_relation родитель;ребёнок" },
+    { "distance",        2, 2, "distance имя;имя" },
+    { "inherit",         2, 2, "inherit имя;сумма" },
+    { "descendants",     1, 1, "descendants имя" },
+    { "ancestors",       1, 1, "ancestors имя" },
+    { "load",            1, 1, "load файл" },
+    { "export",          1, 3, "export файл.dot[;имя;поколений]" },
+    { "stats",           0, 0, "stats" },
+    { "death",           2, 2, "death имя;год смерти (-1 — жив)" },
+    { "summary",         1, 1, "summary имя" },
+    { "aggregates",      1, 1, "aggregates on|off" },
+    { "alive",           0, 0, "alive" },
+    { "born",            2, 2, "born с года;по год" },
+    { "alive_in",        1, 1, "alive_in год" },
+    { "died_before",     1, 1, "died_before год" },
+    { "overlap",         1, 2, "overlap с года[;по год]" },
+    { "find_prefix",     1, 1, "find_prefix начало имени" },
+    { "find_surname",    1, 1, "find_surname начало фамилии" },
+    { "find_fuzzy",      1, 2, "find_fuzzy имя[;опечаток 0..3]" },
+    { "generations",     1, 2, "generations имя[;down|up]" },
+    { "traversal",       2, 2, "traversal потоков;снизу вверх 0|1" },
+    { "count_relatives", 1, 2, "count_relatives имя[;down|up]" }
+};
+
+// Итоги по одному виду команд
+typedef struct {
+    long count;
+    long errors;
+    double seconds;
+} BatchTiming;
+
+static double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Убирает пробельные символы по краям строки (на месте)
+static char* trim(char* s) {
+    while (*s && isspace((unsigned char)*s)) s++;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+// Делит строку аргументов по ';' (на месте); возвращает число аргументов или -1
+static int split_args(char* s, char** args) {
+    if (*s == '\0') return 0;
+    int n = 0;
+    for (;;) {
+        if (n == BATCH_MAX_ARGS) return -1;
+        char* sep = strchr(s, ';');
+        if (sep) *sep = '\0';
+        args[n++] = trim(s);
+        if (!sep) return n;
+        s = sep + 1;
+    }
+}
+
+static int parse_year(const char* s, int* out) {
+    char* end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || v < INT_MIN || v > INT_MAX) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+// Печатает выборку людей и освобождает массив индексов
+static int print_selection(const Graph* g, const char* title, int* ids, int count) {
+    if (count < 0) return -1;
+    printf("%s: %d\n", title, count);
+    for (int i = 0; i < count; i++) {
+        Person p;
+        if (get_person(g, ids[i], &p) == 0)
+            printf(" - %s (%d-%d)\n", p.name, p.birth_year, p.death_year);
+    }
+    free(ids);
+    return 0;
+}
+
+// Выполняет одну команду; возвращает 0 при успехе, -1 при ошибке
+static int run_batch_command(Graph* g, BatchCommand cmd, char** args) {
+    switch (cmd) {
+        case CMD_PERSON: {
+            Person p;
+            p.name = args[0];
+            char sex = args[1][0];
+            if (sex == '\0' || args[1][1] != '\0' || !strchr("MmFf", sex)) return -1;
+            p.gender = (sex == 'M' || sex == 'm') ? MALE : FEMALE;
+            if (parse_year(args[2], &p.birth_year) != 0 || parse_year(args[3], &p.death_year) != 0)
+                return -1;
+            if (add_person(g, p) < 0) return -1;
+            printf("Человек '%s' добавлен\n", p.name);
+            return 0;
+        }
+        case CMD_RELATION:
+            if (add_relation(g, args[0], args[1], PARENT) != 0) return -1;
+            printf("Связь '%s'→'%s' добавлена\n", args[0], args[1]);
+            return 0;
+        case CMD_REMOVE_PERSON:
+            if (remove_person(g, args[0]) != 0) return -1;
+            printf("Вершина '%s' удалена\n", args[0]);
+            return 0;
+        case CMD_REMOVE_RELATION:
+            if (remove_relation(g, args[0], args[1], PARENT) != 0) return -1;
+            printf("Ребро '%s'→'%s' удалено\n", args[0], args[1]);
+            return 0;
+        case CMD_DISTANCE: {
+            if (find_person_index(g, args[0]) < 0 || find_person_index(g, args[1]) < 0) return -1;
+            int dist = shortest_relation_path(g, args[0], args[1]);
+            if (dist >= 0)
+                printf("Расстояние отношений между '%s' и '%s': %d\n", args[0], args[1], dist);
+            else
+                printf("Связь между '%s' и '%s' не найдена\n", args[0], args[1]);
+            return 0;
+        }
+        case CMD_INHERIT: {
+            char* end;
+            double amount = strtod(args[1], &end);
+            if (end == args[1] || *end != '\0') return -1;
+            if (find_person_index(g, args[0]) < 0) return -1;
+            distribute_inheritance(g, args[0], amount);
+            return 0;
+        }
+        case CMD_DESCENDANTS:
+            if (find_person_index(g, args[0]) < 0) return -1;
+            get_descendants(g, args[0]);
+            return 0;
+        case CMD_ANCESTORS:
+            if (find_person_index(g, args[0]) < 0) return -1;
+            get_ancestors(g, args[0]);
+            return 0;
+        case CMD_LOAD: {
+            // сообщения загрузчика (с номерами строк) идут в stderr, итог — в stdout
+            long errors = load_from_file(args[0], g, NULL);
+            printf("\n");
+            return errors == 0 ? 0 : -1;
+        }
+        case CMD_EXPORT:
+            if (args[1]) {
+                int generations;
+                if (!args[2] || parse_year(args[2], &generations) != 0) return -1;
+                int count = export_dot_neighbourhood(g, args[0], args[1], generations);
+                if (count < 0) return -1;
+                printf("Окрестность '%s' (людей: %d) сохранена в %s\n", args[1], count, args[0]);
+            } else {
+                export_dot(g, args[0]);
+                printf("Граф сохранён в %s\n", args[0]);
+            }
+            return 0;
+        case CMD_STATS:
+            print_stats(g);
+            return 0;
+        case CMD_DEATH: {
+            int year;
+            if (parse_year(args[1], &year) != 0 || set_death_year(g, args[0], year) != 0) return -1;
+            printf("Год смерти '%s': %d\n", args[0], year);
+            return 0;
+        }
+        case CMD_SUMMARY: {
+            DescendantSummary sum;
+            if (get_descendant_summary(g, args[0], &sum) != 0) return -1;
+            printf("Потомков '%s': %ld, живых: %ld, суммарный вес: %.6f\n",
+                   args[0], sum.descendants, sum.living, sum.weight);
+            return 0;
+        }
+        case CMD_AGGREGATES:
+            if (strcmp(args[0], "on") != 0 && strcmp(args[0], "off") != 0) return -1;
+            return graph_enable_aggregates(g, strcmp(args[0], "on") == 0);
+        case CMD_ALIVE: {
+            int alive = count_alive(g);
+            if (alive < 0) return -1;
+            printf("Живых: %d из %d\n", alive, g->live_count);
+            return 0;
+        }
+        case CMD_BORN: {
+            int from, to, * ids;
+            if (parse_year(args[0], &from) != 0 || parse_year(args[1], &to) != 0) return -1;
+            int count = filter_by_birth_range(g, from, to, &ids);
+            return print_selection(g, "Родились в эти годы", ids, count);
+        }
+        case CMD_ALIVE_IN: {
+            int year, * ids;
+            if (parse_year(args[0], &year) != 0) return -1;
+            int count = alive_in_year(g, year, &ids);
+            return print_selection(g, "Жили в этом году", ids, count);
+        }
+        case CMD_DIED_BEFORE: {
+            int year, * ids;
+            if (parse_year(args[0], &year) != 0) return -1;
+            int count = filter_died_before(g, year, &ids);
+            return print_selection(g, "Умерли раньше этого года", ids, count);
+        }
+        case CMD_OVERLAP: {
+            int from, to, * ids;
+            if (parse_year(args[0], &from) != 0) return -1;
+            if (!args[1]) to = from;
+            else if (parse_year(args[1], &to) != 0) return -1;
+            int count = lifespan_overlapping(g, from, to, &ids);
+            return print_selection(g, "Жили в эти годы", ids, count);
+        }
+        case CMD_FIND_PREFIX: {
+            int* ids;
+            int count = search_names_prefix(g, args[0], &ids);
+            return print_selection(g, "Найдено по началу имени", ids, count);
+        }
+        case CMD_FIND_SURNAME: {
+            int* ids;
+            int count = search_names_by_surname(g, args[0], &ids);
+            return print_selection(g, "Найдено по фамилии", ids, count);
+        }
+        case CMD_FIND_FUZZY: {
+            int distance = 1, * ids;
+            if (args[1] && parse_year(args[1], &distance) != 0) return -1;
+            int count = search_names_fuzzy(g, args[0], distance, &ids);
+            return print_selection(g, "Найдено похожих имён", ids, count);
+        }
+        case CMD_GENERATIONS: {
+            int down = !args[1] || strcmp(args[1], "down") == 0;
+            if (!down && strcmp(args[1], "up") != 0) return -1;
+            GenerationLevels gl;
+            if (get_generations(g, args[0], down, &gl) != 0) return -1;
+            printf("%s '%s' по поколениям: %d\n", down ? "Потомки" : "Предки", args[0], gl.count);
+            for (int d = 1; d <= gl.generations; d++) {
+                printf("Поколение %d: %d\n", d, gl.level_start[d] - gl.level_start[d - 1]);
+                for (int i = gl.level_start[d - 1]; i < gl.level_start[d]; i++)
+                    printf(" - %s\n", g->vertices[gl.ids[i]].name);
+            }
+            free_generation_levels(&gl);
+            return 0;
+        }
+        case CMD_COUNT_RELATIVES: {
+            int down = !args[1] || strcmp(args[1], "down") == 0;
+            if (!down && strcmp(args[1], "up") != 0) return -1;
+            // только количество: индексы не копируются и не печатаются
+            int count = find_relatives(g, args[0], down, NULL, 0);
+            if (count < 0) return -1;
+            printf("%s '%s': %d\n", down ? "Потомков" : "Предков", args[0], count);
+            return 0;
+        }
+        case CMD_TRAVERSAL: {
+            int threads, bottom_up;
+            if (parse_year(args[0], &threads) != 0 || parse_year(args[1], &bottom_up) != 0) return -1;
+            return graph_set_traversal(g, threads, bottom_up);
+        }
+        default:
+            return -1;
+    }
+}
+
+// Выполняет команды из in по одной в строке без приглашений; вывод буферизуется,
+// по завершении в stderr печатается сводка времени по видам команд.
+// Пустые строки и строки, начинающиеся с '#', пропускаются.
+static int run_batch(Graph* g, FILE* in, const char* source) {
+    static char out_buffer[BATCH_OUT_BUFFER];
+    setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+    BatchTiming timing[CMD_COUNT];
+    memset(timing, 0, sizeof(timing));
+    char line[BATCH_LINE_SIZE];
+    long line_no = 0, total = 0, failed = 0;
+    double start = now_seconds();
+
+    while (fgets(line, sizeof(line), in)) {
+        line_no++;
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            fprintf(stderr, "%s:%ld: строка длиннее %d байт\n", source, line_no, BATCH_LINE_SIZE - 2);
+            failed++;
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n') {}
+            continue;
+        }
+        size_t bad = utf8_find_invalid(line, len, NULL);
+        if (bad < len) {
+            // команда выполняется без некорректных байтов, как и при вводе в меню
+            fprintf(stderr, "%s:%ld:%ld: некорректный UTF-8, такие байты удалены\n",
+                    source, line_no, (long)bad + 1);
+            line[utf8_sanitize(line, len)] = '\0';
+        }
+        char* text = trim(line);
+        if (*text == '\0' || *text == '#') continue;
+
+        char* rest = text;
+        while (*rest && !isspace((unsigned char)*rest)) rest++;
+        if (*rest) *rest++ = '\0';
+        int cmd = 0;
+        while (cmd < CMD_COUNT && strcmp(batch_commands[cmd].name, text) != 0) cmd++;
+        total++;
+        if (cmd == CMD_COUNT) {
+            fprintf(stderr, "%s:%ld: неизвестная команда '%s'\n", source, line_no, text);
+            failed++;
+            continue;
+        }
+        char* args[BATCH_MAX_ARGS] = { NULL };
+        int nargs = split_args(trim(rest), args);
+        if (nargs < batch_commands[cmd].min_args || nargs > batch_commands[cmd].max_args) {
+            fprintf(stderr, "%s:%ld: ожидается '%s'\n", source, line_no, batch_commands[cmd].usage);
+            timing[cmd].errors++;
+            failed++;
+            continue;
+        }
+        double t0 = now_seconds();
+        int rc = run_batch_command(g, (BatchCommand)cmd, args);
+        timing[cmd].seconds += now_seconds() - t0;
+        timing[cmd].count++;
+        if (rc != 0) {
+            fprintf(stderr, "%s:%ld: команда '%s' не выполнена\n", source, line_no, text);
+            timing[cmd].errors++;
+            failed++;
+        }
+    }
+    fflush(stdout);
+
+    double elapsed = now_seconds() - start;
+    fprintf(stderr, "Команд: %ld, с ошибками: %ld, время: %.3f с\n", total, failed, elapsed);
+    for (int i = 0; i < CMD_COUNT; i++) {
+        if (timing[i].count == 0 && timing[i].errors == 0) continue;
+        fprintf(stderr, "  %-16s %8ld раз, ошибок %6ld, всего %10.3f мс, в среднем %10.3f мкс\n",
+                batch_commands[i].name, timing[i].count, timing[i].errors, timing[i].seconds * 1e3,
+                timing[i].count ? timing[i].seconds * 1e6 / timing[i].count : 0.0);
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Использование: %s [-b файл]\n"
+                    "  без параметров — интерактивное меню\n"
+                    "  -b файл        — пакетный режим: команды из файла ('-' или без имени — из stdin)\n",
+            prog);
+}
+
+int main(int argc, char** argv) {
     setlocale(LC_ALL, "");
+    if (argc > 1 && strcmp(argv[1], "-b") != 0) {
+        usage(argv[0]);
+        return 2;
+    }
     Graph* g = create_graph();
     if (!g) {
         fprintf(stderr, RED "Ошибка создания графа" RESET);
         return 1;
     }
+    graph_set_query_cache(g, QUERY_CACHE_ENTRIES);
+    graph_set_traversal(g, thread_pool_default_size(), 0);
+    if (argc > 1) {
+        const char* source = argc > 2 ? argv[2] : "-";
+        FILE* in = strcmp(source, "-") == 0 ? stdin : fopen(source, "r");
+        if (!in) {
+            perror(source);
+            free_graph(g);
+            return 1;
+        }
+        int rc = run_batch(g, in, in == stdin ? "stdin" : source);
+        if (in != stdin) fclose(in);
+        free_graph(g);
+        return rc;
+    }
+    SvgRenderer* renderer = svg_renderer_create();
 
     int choice = -1;
     char buf[128];
@@ -158,6 +483,7 @@ int main() {
     Person tmp;
 
     while (1) {
+        report_renders(renderer);
         print_menu();
         if (!fgets(buf, sizeof(buf), stdin)) break;
         choice = atoi(buf);
@@ -222,7 +548,7 @@ int main() {
                         Edge* e = g->vertices[fi].edges;
                         while (e) {
                             printf("  -> %s (relation=%s)",
-                                   g->vertices[e->to].person.name,
+                                   g->vertices[e->to].name,
                                    e->relation==PARENT? "PARENT":"CHILD");
                             e = e->next;
                         }
@@ -243,9 +569,39 @@ int main() {
                 char dot_path[128], svg_path[128];
                 snprintf(dot_path, sizeof(dot_path), "%s.dot", basename);
                 snprintf(svg_path, sizeof(svg_path), "%s.svg", basename);
-                export_dot(g, dot_path);
-                render_svg(dot_path, svg_path);
-                printf(GREEN "Граф сохранён в файлы: %s и %s" RESET, dot_path, svg_path);
+                printf("Человек в центре (пусто — весь граф): ");
+                read_line(name1, sizeof(name1));
+                int generations = 0;
+                if (name1[0] != '\0') {
+                    printf("Число поколений вокруг него: ");
+                    read_line(buf, sizeof(buf));
+                    generations = atoi(buf);
+                }
+                printf("Сохранить также .dot-файл? (y/N): ");
+                read_line(buf, sizeof(buf));
+                int keep_dot = buf[0] == 'y' || buf[0] == 'Y';
+                const char* center = name1[0] ? name1 : NULL;
+                if (!renderer) {
+                    // без фонового потока рисуем как раньше — через файл и синхронно
+                    if (center) {
+                        if (export_dot_neighbourhood(g, dot_path, center, generations) < 0) {
+                            printf(RED "Человек '%s' не найден или файл недоступен" RESET, name1);
+                            break;
+                        }
+                    } else {
+                        export_dot(g, dot_path);
+                    }
+                    render_svg(dot_path, svg_path);
+                    printf(GREEN "Граф сохранён в файлы: %s и %s" RESET, dot_path, svg_path);
+                    break;
+                }
+                if (svg_renderer_submit(renderer, g, svg_path, keep_dot ? dot_path : NULL,
+                                        center, generations) != 0) {
+                    printf(RED "Не удалось подготовить граф (нет человека '%s'?)" RESET, name1);
+                    break;
+                }
+                printf(GREEN "Граф отправлен на отрисовку в %s%s%s" RESET, svg_path,
+                       keep_dot ? ", текст — в " : "", keep_dot ? dot_path : "");
                 break;
             }
 
@@ -277,7 +633,7 @@ int main() {
             case 9:
                 printf("Имя файла: ");
                 read_line(buf, sizeof(buf));       // или fgets+clean_input
-                load_from_file(buf, g);
+                load_from_file(buf, g, NULL);
                 break;
 
             case 10:
@@ -286,8 +642,94 @@ int main() {
                 get_descendants(g, name1);
                 break;
 
+            case 11:
+                printf("Введите имя человека для поиска предков: ");
+                read_line(name1, sizeof(name1));
+                get_ancestors(g, name1);
+                break;
+
+            case 12:
+                printf("Имя первого человека: ");
+                read_line(name1, sizeof(name1));
+                printf("Имя второго человека: ");
+                read_line(name2, sizeof(name2));
+                {
+                    Kinship k;
+                    if (find_kinship(g, name1, name2, &k) != 0) {
+                        printf(YELLOW "Общий предок '%s' и '%s' не найден" RESET, name1, name2);
+                        break;
+                    }
+                    printf(GREEN "Ближайший общий предок: '%s' (поколений: %d и %d)\n" RESET,
+                           g->vertices[k.ancestor].name, k.depth_a, k.depth_b);
+                    if (k.depth_a == 0 || k.depth_b == 0) {
+                        printf("Родство по прямой линии");
+                    } else {
+                        int degree = (k.depth_a < k.depth_b ? k.depth_a : k.depth_b) - 1;
+                        int removed = abs(k.depth_a - k.depth_b);
+                        if (degree == 0) printf("Братья/сёстры");
+                        else printf("Кузены %d-й степени", degree);
+                        if (removed > 0) printf(", удалённые на %d покол.", removed);
+                    }
+                }
+                break;
+
+            case 13:
+                printf("Имя файла снимка: ");
+                read_line(buf, sizeof(buf));
+                if (save_snapshot(g, buf) == 0)
+                    printf(GREEN "Снимок сохранён в %s" RESET, buf);
+                else
+                    printf(RED "Не удалось сохранить снимок в %s" RESET, buf);
+                break;
+
+            case 14: {
+                printf("Имя файла снимка: ");
+                read_line(buf, sizeof(buf));
+                Graph* loaded = load_snapshot(buf);
+                if (!loaded) {
+                    printf(RED "Не удалось загрузить снимок %s" RESET, buf);
+                    break;
+                }
+                // снимок заменяет текущий граф целиком
+                free_graph(g);
+                g = loaded;
+                graph_set_query_cache(g, QUERY_CACHE_ENTRIES);
+                graph_set_traversal(g, thread_pool_default_size(), 0);
+                printf(GREEN "Снимок загружен из %s (людей: %d)" RESET, buf, g->live_count);
+                break;
+            }
+
+            case 15:
+                print_stats(g);
+                break;
+
+            case 16: {
+                printf("Начало имени или фамилии: ");
+                read_line(name1, sizeof(name1));
+                // сначала начало полного имени, затем фамилия, в последнюю очередь — похожие имена
+                int* ids;
+                int count = search_names_prefix(g, name1, &ids);
+                const char* title = "Найдено по началу имени";
+                if (count == 0) {
+                    free(ids);
+                    count = search_names_by_surname(g, name1, &ids);
+                    title = "Найдено по фамилии";
+                }
+                if (count == 0) {
+                    free(ids);
+                    count = search_names_fuzzy(g, name1, 2, &ids);
+                    title = "Найдено похожих имён";
+                }
+                if (print_selection(g, title, ids, count) != 0)
+                    printf(RED "Поиск по имени не удался" RESET);
+                break;
+            }
+
             case 0:
                 printf(YELLOW "Выход..." RESET);
+                svg_renderer_wait(renderer);
+                report_renders(renderer);
+                svg_renderer_free(renderer);
                 free_graph(g);
                 return 0;
 
@@ -296,6 +738,7 @@ int main() {
         }
     }
 
+    svg_renderer_free(renderer);
     free_graph(g);
     return 0;
 }
@@ -0,0 +1,70 @@
+#define _DEFAULT_SOURCE // madvise и MADV_SEQUENTIAL видны и при сборке с -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mmfile.h"
+
+// Отображает файл; writable — страницы доступны для записи с копированием при записи
+static int map_file_mode(const char* filename, MappedFile* mf, int writable) {
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+#ifdef _WIN32
+    FILE* f = fopen(filename, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buf = malloc(len > 0 ? (size_t)len : 1);
+    if (!buf || (len > 0 && fread(buf, 1, (size_t)len, f) != (size_t)len)) {
+        free(buf);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    mf->data = buf;
+    mf->size = (size_t)len;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    if (st.st_size > 0) {
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void* p = mmap(NULL, (size_t)st.st_size, prot, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(fd); return -1; }
+        if (!writable) madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        mf->data = p;
+        mf->size = (size_t)st.st_size;
+        mf->mapped = 1;
+    }
+    close(fd); // отображение остаётся действительным и после закрытия
+#endif
+    (void)writable; // в Windows буфер и так доступен для записи
+    return 0;
+}
+
+int map_file(const char* filename, MappedFile* mf) {
+    return map_file_mode(filename, mf, 0);
+}
+
+int map_file_private(const char* filename, MappedFile* mf) {
+    return map_file_mode(filename, mf, 1);
+}
+
+void unmap_file(MappedFile* mf) {
+#ifdef _WIN32
+    free((void*)mf->data);
+#else
+    if (mf->mapped) munmap((void*)mf->data, mf->size);
+#endif
+    mf->data = NULL;
+    mf->size = 0;
+    mf->mapped = 0;
+}
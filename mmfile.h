@@ -0,0 +1,37 @@
+#ifndef MMFILE_H
+#define MMFILE_H
+
+#include <stddef.h>
+
+// Содержимое файла: отображение в память (POSIX) или целиком прочитанный буфер (Windows).
+// Доступно только для чтения, если получено map_file.
+typedef struct {
+    const char* data;  // Начало содержимого (NULL для пустого файла)
+    size_t size;       // Размер в байтах
+    int mapped;        // 1, если data получено через mmap
+} MappedFile;
+
+/**
+ * Открывает файл и делает его содержимое доступным в памяти.
+ * @param filename Путь к файлу.
+ * @param mf Структура для результата.
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int map_file(const char* filename, MappedFile* mf);
+
+/**
+ * Как map_file, но содержимое можно изменять: изменённые страницы копируются
+ * в память процесса, а сам файл остаётся прежним.
+ * @param filename Путь к файлу.
+ * @param mf Структура для результата.
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int map_file_private(const char* filename, MappedFile* mf);
+
+/**
+ * Освобождает отображение (или буфер), полученное map_file.
+ * @param mf Отображённый файл.
+ */
+void unmap_file(MappedFile* mf);
+
+#endif
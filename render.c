@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L // popen, clock_gettime и pthread_sigmask объявлены и при -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#include "render.h"
+
+#define RENDER_MAX_RESULTS 16 // сколько непрочитанных итогов хранится (старые вытесняются)
+#define RENDER_CMD_SIZE (2 * RENDER_MAX_PATH + 64)
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define RENDER_PIPE_MODE "wb"
+#else
+#define RENDER_PIPE_MODE "w"
+#endif
+
+// Запрос на отрисовку: готовый текст DOT и пути
+typedef struct {
+    char* dot;
+    size_t size;
+    char svg_path[RENDER_MAX_PATH];
+    char dot_path[RENDER_MAX_PATH];  // Пустая строка — .dot-файл не сохраняется
+    long superseded;
+} RenderJob;
+
+struct SvgRenderer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // Появился запрос или пора завершаться
+    RenderJob* pending;         // Ожидающий запрос (не больше одного)
+    int running;                // 1, пока поток выполняет запрос
+    int shutdown;               // 1 — поток должен завершиться после ожидающего запроса
+    RenderResult results[RENDER_MAX_RESULTS]; // Кольцо завершённых отрисовок
+    int result_head;
+    int result_count;
+};
+
+static void free_job(RenderJob* job) {
+    if (!job) return;
+    free(job->dot);
+    free(job);
+}
+
+// Дописывает путь в кавычках для командной оболочки
+static int append_quoted(char* cmd, size_t size, const char* path) {
+    size_t len = strlen(cmd);
+#ifdef _WIN32
+    // в cmd.exe кавычки внутри имени файла недопустимы
+    if (strchr(path, '"')) return -1;
+    int n = snprintf(cmd + len, size - len, "\"%s\"", path);
+    return n < 0 || (size_t)n >= size - len ? -1 : 0;
+#else
+    // одинарные кавычки, каждая ' внутри пути заменяется на '\''
+    if (len + 1 >= size) return -1;
+    cmd[len++] = '\'';
+    for (const char* p = path; *p; p++) {
+        const char* piece = *p == '\'' ? "'\\''" : NULL;
+        size_t plen = piece ? 4 : 1;
+        if (len + plen + 1 >= size) return -1;
+        if (piece) memcpy(cmd + len, piece, plen);
+        else cmd[len] = *p;
+        len += plen;
+    }
+    if (len + 2 > size) return -1;
+    cmd[len++] = '\'';
+    cmd[len] = '\0';
+    return 0;
+#endif
+}
+
+static double wall_seconds(void) {
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Выполняет один запрос: при необходимости сохраняет .dot, затем передаёт
+// текст утилите dot через канал (без промежуточного файла)
+static void run_job(const RenderJob* job, RenderResult* res) {
+    double start = wall_seconds();
+    memset(res, 0, sizeof(*res));
+    snprintf(res->svg_path, sizeof(res->svg_path), "%s", job->svg_path);
+    res->superseded = job->superseded;
+    res->exit_code = -1;
+
+    if (job->dot_path[0]) {
+        FILE* f = fopen(job->dot_path, "wb");
+        if (f) {
+            fwrite(job->dot, 1, job->size, f);
+            fclose(f);
+        }
+    }
+
+    char cmd[RENDER_CMD_SIZE] = "dot -Tsvg -o ";
+    if (append_quoted(cmd, sizeof(cmd), job->svg_path) != 0) return;
+    FILE* p = popen(cmd, RENDER_PIPE_MODE);
+    if (!p) return;
+    size_t written = fwrite(job->dot, 1, job->size, p);
+    int status = pclose(p);
+#ifdef _WIN32
+    res->exit_code = status;
+#else
+    res->exit_code = status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#endif
+    res->ok = written == job->size && res->exit_code == 0;
+    res->seconds = wall_seconds() - start;
+}
+
+static void* render_thread(void* arg) {
+    SvgRenderer* r = arg;
+#ifndef _WIN32
+    // если dot не запустился, запись в канал должна вернуть ошибку, а не завершить процесс
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->pending && !r->shutdown) pthread_cond_wait(&r->wake, &r->lock);
+        if (!r->pending) break;
+        RenderJob* job = r->pending;
+        r->pending = NULL;
+        r->running = 1;
+        pthread_mutex_unlock(&r->lock);
+
+        RenderResult res;
+        run_job(job, &res);
+        free_job(job);
+
+        pthread_mutex_lock(&r->lock);
+        int slot = (r->result_head + r->result_count) % RENDER_MAX_RESULTS;
+        if (r->result_count == RENDER_MAX_RESULTS)
+            r->result_head = (r->result_head + 1) % RENDER_MAX_RESULTS;
+        else
+            r->result_count++;
+        r->results[slot] = res;
+        r->running = 0;
+        pthread_cond_broadcast(&r->wake);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+SvgRenderer* svg_renderer_create(void) {
+    SvgRenderer* r = calloc(1, sizeof(SvgRenderer));
+    if (!r) return NULL;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    if (pthread_create(&r->thread, NULL, render_thread, r) != 0) {
+        pthread_cond_destroy(&r->wake);
+        pthread_mutex_destroy(&r->lock);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+int svg_renderer_submit(SvgRenderer* r, Graph* g, const char* svg_path, const char* dot_path,
+                        const char* name, int generations) {
+    if (!r || !g || !svg_path || strlen(svg_path) >= RENDER_MAX_PATH) return -1;
+    if (dot_path && strlen(dot_path) >= RENDER_MAX_PATH) return -1;
+    RenderJob* job = calloc(1, sizeof(RenderJob));
+    if (!job) return -1;
+    // текст формируется здесь, в потоке владельца графа: фоновый поток граф не читает
+    job->dot = export_dot_buffer(g, name, generations, &job->size);
+    if (!job->dot) {
+        free(job);
+        return -1;
+    }
+    strcpy(job->svg_path, svg_path);
+    if (dot_path) strcpy(job->dot_path, dot_path);
+
+    pthread_mutex_lock(&r->lock);
+    RenderJob* old = r->pending;
+    if (old) job->superseded = old->superseded + 1;
+    r->pending = job;
+    pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    // заменённый запрос так и не начался — сохранённый им .dot тоже не нужен
+    free_job(old);
+    return 0;
+}
+
+int svg_renderer_poll(SvgRenderer* r, RenderResult* out) {
+    if (!r || !out) return 0;
+    pthread_mutex_lock(&r->lock);
+    int got = r->result_count > 0;
+    if (got) {
+        *out = r->results[r->result_head];
+        r->result_head = (r->result_head + 1) % RENDER_MAX_RESULTS;
+        r->result_count--;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return got;
+}
+
+int svg_renderer_busy(SvgRenderer* r) {
+    if (!r) return 0;
+    pthread_mutex_lock(&r->lock);
+    int busy = r->pending != NULL || r->running;
+    pthread_mutex_unlock(&r->lock);
+    return busy;
+}
+
+void svg_renderer_wait(SvgRenderer* r) {
+    if (!r) return;
+    pthread_mutex_lock(&r->lock);
+    while (r->pending || r->running) pthread_cond_wait(&r->wake, &r->lock);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void svg_renderer_free(SvgRenderer* r) {
+    if (!r) return;
+    pthread_mutex_lock(&r->lock);
+    r->shutdown = 1;
+    pthread_cond_broadcast(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    free_job(r->pending);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
@@ -0,0 +1,69 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "graph.h"
+
+#define RENDER_MAX_PATH 256 // максимальная длина пути к файлу рисунка
+
+// Итог одной фоновой отрисовки
+typedef struct {
+    char svg_path[RENDER_MAX_PATH];  // Куда записан рисунок
+    int ok;                          // 1 — dot завершился успешно
+    int exit_code;                   // Код завершения dot (-1 — не удалось запустить)
+    double seconds;                  // Время работы dot
+    long superseded;                 // Сколько запросов заменено этим (не отрисовывались)
+} RenderResult;
+
+// Фоновый отрисовщик: поток, который передаёт текст DOT утилите dot через канал
+typedef struct SvgRenderer SvgRenderer;
+
+/**
+ * Создаёт отрисовщик и запускает его фоновый поток.
+ * @return Указатель на отрисовщик или NULL при ошибке.
+ */
+SvgRenderer* svg_renderer_create(void);
+
+/**
+ * Ставит отрисовку графа в очередь и сразу возвращает управление.
+ * Текст DOT формируется в момент вызова, поэтому рисунок отражает граф именно
+ * на этот момент. Если предыдущий запрос ещё не начат, он заменяется новым:
+ * отрисовывается только последнее состояние.
+ * @param r Указатель на отрисовщик.
+ * @param g Указатель на граф.
+ * @param svg_path Путь к выходному svg-файлу.
+ * @param dot_path Путь для сохранения .dot-файла или NULL, если он не нужен.
+ * @param name Человек в центре окрестности или NULL для всего графа.
+ * @param generations Радиус окрестности (при name == NULL не используется).
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int svg_renderer_submit(SvgRenderer* r, Graph* g, const char* svg_path, const char* dot_path,
+                        const char* name, int generations);
+
+/**
+ * Забирает итог самой старой из завершённых отрисовок, не дожидаясь новых.
+ * @param r Указатель на отрисовщик.
+ * @param out Итог отрисовки.
+ * @return 1, если итог получен, 0 — если завершённых отрисовок нет.
+ */
+int svg_renderer_poll(SvgRenderer* r, RenderResult* out);
+
+/**
+ * Проверяет, занят ли отрисовщик (идёт или ожидает отрисовка).
+ * @param r Указатель на отрисовщик.
+ * @return 1, если занят, иначе 0.
+ */
+int svg_renderer_busy(SvgRenderer* r);
+
+/**
+ * Дожидается завершения текущей и ожидающей отрисовки.
+ * @param r Указатель на отрисовщик.
+ */
+void svg_renderer_wait(SvgRenderer* r);
+
+/**
+ * Дожидается текущей и ожидающей отрисовки, останавливает поток и освобождает отрисовщик.
+ * @param r Указатель на отрисовщик (может быть NULL).
+ */
+void svg_renderer_free(SvgRenderer* r);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "threadpool.h"
+
+#define POOL_SLICE (1L << 30) // максимум элементов за один проход (диапазон хранится в 32-битных половинах)
+
+// Диапазон индексов исполнителя [lo, hi), упакованный в одно слово:
+// старшие 32 бита — lo, младшие — hi. Владелец забирает элементы с начала,
+// другие исполнители отрезают половину с конца; обе операции — CAS над словом.
+typedef struct {
+    _Atomic uint64_t range;
+    char pad[64 - sizeof(uint64_t)]; // отдельная строка кэша на исполнителя
+} WorkRange;
+
+struct ThreadPool {
+    int size;                   // Число исполнителей (включая вызывающий поток)
+    pthread_t* threads;         // Рабочие потоки (size - 1)
+    WorkRange* ranges;          // Диапазоны работы исполнителей
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;  // Сигнал о новой работе
+    pthread_cond_t done_cond;   // Сигнал о завершении работы
+    unsigned long generation;   // Номер текущего прохода
+    int active;                 // Сколько рабочих потоков ещё заняты проходом
+    int shutdown;               // 1 — потоки должны завершиться
+    ParallelTask task;          // Текущая задача
+    void* ctx;                  // Контекст текущей задачи
+    long base;                  // Смещение индексов текущего прохода
+};
+
+static uint64_t pack_range(uint32_t lo, uint32_t hi) {
+    return ((uint64_t)lo << 32) | hi;
+}
+
+// Забирает следующий элемент из собственного диапазона
+static int take_own(WorkRange* r, uint32_t* out) {
+    uint64_t cur = atomic_load(&r->range);
+    for (;;) {
+        uint32_t lo = (uint32_t)(cur >> 32), hi = (uint32_t)cur;
+        if (lo >= hi) return 0;
+        if (atomic_compare_exchange_weak(&r->range, &cur, pack_range(lo + 1, hi))) {
+            *out = lo;
+            return 1;
+        }
+    }
+}
+
+// Отрезает половину чужого диапазона и делает её своей
+static int steal(WorkRange* victim, WorkRange* own) {
+    uint64_t cur = atomic_load(&victim->range);
+    for (;;) {
+        uint32_t lo = (uint32_t)(cur >> 32), hi = (uint32_t)cur;
+        if (lo >= hi) return 0;
+        uint32_t take = (hi - lo + 1) / 2;
+        if (atomic_compare_exchange_weak(&victim->range, &cur, pack_range(lo, hi - take))) {
+            atomic_store(&own->range, pack_range(hi - take, hi));
+            return 1;
+        }
+    }
+}
+
+static void run_worker(ThreadPool* pool, int id) {
+    WorkRange* own = &pool->ranges[id];
+    for (;;) {
+        uint32_t idx;
+        while (take_own(own, &idx)) pool->task(pool->ctx, id, pool->base + (long)idx);
+        int stolen = 0;
+        for (int k = 1; k < pool->size && !stolen; k++)
+            stolen = steal(&pool->ranges[(id + k) % pool->size], own);
+        if (!stolen) return; // работы не осталось ни у кого
+    }
+}
+
+static void* worker_main(void* arg) {
+    ThreadPool* pool = ((void**)arg)[0];
+    int id = (int)(intptr_t)((void**)arg)[1];
+    free(arg);
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen)
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        run_worker(pool, id);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int thread_pool_default_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int n = (int)si.dwNumberOfProcessors;
+#else
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n < 1 ? 1 : n;
+}
+
+ThreadPool* thread_pool_create(int threads) {
+    if (threads < 1) threads = 1;
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+    pool->ranges = calloc(threads, sizeof(WorkRange));
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->ranges || !pool->threads) {
+        free(pool->ranges);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->size = 1;
+    for (int i = 1; i < threads; i++) {
+        void** arg = malloc(2 * sizeof(void*));
+        if (!arg) break;
+        arg[0] = pool;
+        arg[1] = (void*)(intptr_t)i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, arg) != 0) {
+            free(arg);
+            break; // работаем с теми потоками, что удалось создать
+        }
+        pool->size++;
+    }
+    return pool;
+}
+
+void thread_pool_free(ThreadPool* pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 1; i < pool->size; i++) pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
+
+int thread_pool_size(const ThreadPool* pool) {
+    return pool ? pool->size : 1;
+}
+
+void thread_pool_run(ThreadPool* pool, long count, ParallelTask task, void* ctx) {
+    for (long base = 0; base < count; base += POOL_SLICE) {
+        long n = count - base < POOL_SLICE ? count - base : POOL_SLICE;
+        // начальное разбиение — поровну между исполнителями
+        for (int i = 0; i < pool->size; i++) {
+            uint32_t lo = (uint32_t)(n * i / pool->size);
+            uint32_t hi = (uint32_t)(n * (i + 1) / pool->size);
+            atomic_store(&pool->ranges[i].range, pack_range(lo, hi));
+        }
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->ctx = ctx;
+        pool->base = base;
+        pool->active = pool->size - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(pool, 0);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->active > 0) pthread_cond_wait(&pool->done_cond, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
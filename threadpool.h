@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Задача пула: обработать элемент index; worker — номер исполнителя (0..size-1),
+// по нему задача выбирает собственные рабочие буферы
+typedef void (*ParallelTask)(void* ctx, int worker, long index);
+
+// Пул потоков с перехватом работы (work stealing)
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Создаёт пул из threads исполнителей. Вызывающий поток тоже считается исполнителем,
+ * поэтому запускается threads - 1 рабочих потоков.
+ * @param threads Число исполнителей (не меньше 1).
+ * @return Указатель на пул или NULL при ошибке.
+ */
+ThreadPool* thread_pool_create(int threads);
+
+/**
+ * Число исполнителей по умолчанию — по количеству процессоров.
+ * @return Число исполнителей, не меньше 1.
+ */
+int thread_pool_default_size(void);
+
+/**
+ * Останавливает рабочие потоки и освобождает пул.
+ * @param pool Указатель на пул (может быть NULL).
+ */
+void thread_pool_free(ThreadPool* pool);
+
+/**
+ * Количество исполнителей пула.
+ * @param pool Указатель на пул.
+ * @return Число исполнителей, включая вызывающий поток.
+ */
+int thread_pool_size(const ThreadPool* pool);
+
+/**
+ * Выполняет task для индексов 0..count-1 и ждёт завершения всех.
+ * Индексы делятся между исполнителями поровну; освободившийся исполнитель
+ * забирает половину оставшейся работы у другого.
+ * @param pool Указатель на пул.
+ * @param count Количество элементов.
+ * @param task Функция обработки одного элемента.
+ * @param ctx Контекст, передаваемый в task.
+ */
+void thread_pool_run(ThreadPool* pool, long count, ParallelTask task, void* ctx);
+
+#endif
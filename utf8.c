@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "utf8.h"
+
+#define UTF8_SCALAR_STEP 64 // сколько байт проверяется побайтно после блока, не прошедшего векторную проверку
+
+
+// ----------- Побайтная проверка -------------- //
+// Длина корректного начала последовательности в s; *need — полная длина
+// последовательности (1 для байта, который не может её начинать; тогда возвращается 0)
+static size_t sequence_prefix(const unsigned char* s, size_t avail, size_t* need) {
+    unsigned char c = s[0];
+    if (c < 0x80) {
+        *need = 1;
+        return 1;
+    }
+    if (c < 0xC2 || c > 0xF4) {
+        *need = 1;
+        return 0;
+    }
+    *need = c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    // второй байт ограничен сильнее: так отсекаются длинные кодировки,
+    // суррогаты и символы после U+10FFFF
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (c == 0xE0) lo = 0xA0;
+    else if (c == 0xED) hi = 0x9F;
+    else if (c == 0xF0) lo = 0x90;
+    else if (c == 0xF4) hi = 0x8F;
+    size_t n = 1;
+    while (n < *need && n < avail && s[n] >= lo && s[n] <= hi) {
+        n++;
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    return n;
+}
+
+
+// ----------- Векторная проверка -------------- //
+// Проходит блоки, состоящие только из ASCII и двухбайтовых символов: в таком блоке
+// продолжения (10xxxxxx) стоят ровно на следующих за ведущими байтами 110xxxxx
+// позициях, что сверяется масками. Возвращает начало символа, с которого нужна
+// побайтная проверка; все байты до него корректны.
+static size_t vector_scan(const unsigned char* p, size_t i, size_t len) {
+    unsigned pending = 0; // последний байт предыдущего блока — ведущий, продолжение в этом блоке
+#if defined(__AVX2__)
+    const __m256i cont_limit = _mm256_set1_epi8((char)0xC0);
+    const __m256i lead_low = _mm256_set1_epi8((char)0xC1);
+    const __m256i lead_high = _mm256_set1_epi8((char)0xE0);
+    while (i + 32 <= len) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint32_t high = (uint32_t)_mm256_movemask_epi8(x);
+        if (high == 0 && !pending) {
+            i += 32;
+            continue;
+        }
+        // байты со старшим битом отрицательны при знаковом сравнении
+        uint32_t cont = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(cont_limit, x));
+        uint32_t lead = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpgt_epi8(x, lead_low), _mm256_cmpgt_epi8(lead_high, x)));
+        if ((high & ~(cont | lead)) != 0 || cont != ((lead << 1) | pending)) break;
+        pending = lead >> 31;
+        i += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i cont_limit = _mm_set1_epi8((char)0xC0);
+    const __m128i lead_low = _mm_set1_epi8((char)0xC1);
+    const __m128i lead_high = _mm_set1_epi8((char)0xE0);
+    while (i + 16 <= len) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+        unsigned high = (unsigned)_mm_movemask_epi8(x);
+        if (high == 0 && !pending) {
+            i += 16;
+            continue;
+        }
+        unsigned cont = (unsigned)_mm_movemask_epi8(_mm_cmplt_epi8(x, cont_limit));
+        unsigned lead = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpgt_epi8(x, lead_low), _mm_cmplt_epi8(x, lead_high)));
+        if ((high & ~(cont | lead)) != 0 || cont != (((lead << 1) | pending) & 0xFFFF)) break;
+        pending = lead >> 15;
+        i += 16;
+    }
+#else
+    (void)p;
+    (void)len;
+#endif
+    return i - pending;
+}
+
+
+// ----------- Проверка буферов -------------- //
+size_t utf8_find_invalid(const char* s, size_t len, size_t* bad_len) {
+    const unsigned char* p = (const unsigned char*)s;
+    size_t i = 0;
+    while (i < len) {
+        i = vector_scan(p, i, len);
+        // блок с трёх- и четырёхбайтовыми символами или ошибкой разбирается побайтно
+        size_t limit = i + UTF8_SCALAR_STEP;
+        while (i < len && i < limit) {
+            size_t need, n = sequence_prefix(p + i, len - i, &need);
+            if (n != need) {
+                if (bad_len) *bad_len = n > 0 ? n : 1;
+                return i;
+            }
+            i += n;
+        }
+    }
+    return len;
+}
+
+size_t utf8_validate(const char* s, size_t len, Utf8Error* errors, size_t max_errors) {
+    size_t count = 0, i = 0;
+    while (i < len) {
+        size_t bad_len;
+        size_t bad = i + utf8_find_invalid(s + i, len - i, &bad_len);
+        if (bad == len) break;
+        if (errors && count < max_errors) {
+            errors[count].offset = bad;
+            errors[count].length = bad_len;
+        }
+        count++;
+        i = bad + bad_len;
+    }
+    return count;
+}
+
+size_t utf8_sanitize(char* s, size_t len) {
+    size_t out = 0, i = 0;
+    while (i < len) {
+        size_t bad_len;
+        size_t bad = i + utf8_find_invalid(s + i, len - i, &bad_len);
+        if (out != i) memmove(s + out, s + i, bad - i);
+        out += bad - i;
+        if (bad == len) break;
+        i = bad + bad_len;
+    }
+    return out;
+}
@@ -0,0 +1,46 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+// Некорректная последовательность UTF-8: смещение от начала буфера и длина в байтах
+typedef struct {
+    size_t offset;
+    size_t length;
+} Utf8Error;
+
+/**
+ * Находит первую некорректную последовательность UTF-8.
+ * Корректными считаются только кратчайшие кодировки символов до U+10FFFF без
+ * суррогатов. Некорректная последовательность — самое длинное начало допустимой
+ * последовательности (не меньше одного байта), после которого декодирование
+ * продолжается со следующего байта.
+ * Блоки из ASCII и двухбайтовых символов (латиница, кириллица) проверяются
+ * векторно (SSE2/AVX2), остальные — побайтно.
+ * @param s Буфер (нулевые байты допустимы).
+ * @param len Длина буфера.
+ * @param bad_len Длина найденной последовательности (может быть NULL).
+ * @return Смещение первой некорректной последовательности или len, если буфер корректен.
+ */
+size_t utf8_find_invalid(const char* s, size_t len, size_t* bad_len);
+
+/**
+ * Проверяет буфер целиком и сообщает смещения некорректных последовательностей.
+ * @param s Буфер.
+ * @param len Длина буфера.
+ * @param errors Массив для первых max_errors ошибок (может быть NULL).
+ * @param max_errors Вместимость errors.
+ * @return Количество некорректных последовательностей (0 — буфер корректен).
+ */
+size_t utf8_validate(const char* s, size_t len, Utf8Error* errors, size_t max_errors);
+
+/**
+ * Удаляет некорректные последовательности на месте; корректные байты сдвигаются к началу.
+ * Завершающий ноль не дописывается.
+ * @param s Буфер.
+ * @param len Длина буфера.
+ * @return Новая длина.
+ */
+size_t utf8_sanitize(char* s, size_t len);
+
+#endif